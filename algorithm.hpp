@@ -4,6 +4,12 @@
 
 #include <vector>
 #include <stack>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <mutex>
 
 #include <sdsl/bit_vectors.hpp>
 #include "debruijn_graph.hpp"
@@ -13,32 +19,70 @@
 using namespace std;
 //using namespace sdsl;
 
+// Calls f(begin, end) for num_threads contiguous parts of [0, n), each in its own thread (but with fewer threads
+// if that would give them less than min_part each, since starting a thread isn't free)
+template <class F>
+void parallel_for_ranges(size_t n, size_t num_threads, const F & f, size_t min_part = 4096) {
+  num_threads = std::max((size_t)1, std::min(num_threads, n / std::max((size_t)1, min_part)));
+  if (num_threads == 1) {
+    f(0, n);
+    return;
+  }
+  vector<thread> threads;
+  for (size_t t = 0; t < num_threads; t++) {
+    threads.push_back(thread([&, t]() { f(n * t / num_threads, n * (t+1) / num_threads); }));
+  }
+  for (auto & t : threads) t.join();
+}
+
+// Sets bit i of a bit_vector while other threads may be setting other bits in the same word
+inline void atomic_assign_bit(sdsl::bit_vector & v, size_t i, bool value) {
+  uint64_t * word = v.data() + i/64;
+  uint64_t mask = 1ULL << (i%64);
+  if (value) __atomic_fetch_or(word, mask, __ATOMIC_RELAXED);
+  else __atomic_fetch_and(word, ~mask, __ATOMIC_RELAXED);
+}
+
 // Calling it with a vector of first minus positions is sliiiightly faster
 // But would mean we have to save another vector with our graph if we ever want to traverse
 // it again.
 // If a vector isnt provided, another method is used which is *almost as fast*
+// The outdegree flags are computed a word at a time, with each thread writing its own words, and the indegree
+// flags with each thread taking part of the minus flags (and setting the bits atomically).
 template <bool has_branch = 1, class G, class V=sdsl::sd_vector<> >
-V make_branch_vector(const G& g, const vector<size_t> * v = nullptr) {
-  sdsl::bit_vector branching_flags(g.num_edges(),!has_branch);
+V make_branch_vector(const G& g, const vector<size_t> * v = nullptr, size_t num_threads = 1) {
+  size_t num_edges = g.num_edges();
+  sdsl::bit_vector branching_flags(num_edges,!has_branch);
+  if (num_edges == 0) return V(branching_flags);
   // OUTDEGREE
-  for (size_t edge = 0; edge < g.num_edges()-1; edge++) {
-    // This will only unset the bits that are 0,0 (which means no 11, 10, or 01, which is a sibling edge)
-    // 0,0 -> !has_branch, 0,1 -> has_branch,
-    // 1,0 ->  has_branch, 1,1 -> has_branch,
-    branching_flags[edge] = ((g.m_node_flags[edge] || g.m_node_flags[edge+1]) == has_branch);
-  }
-  // The last edge is whatever it is in the graph
-  // 0 -> !has_branch, 1-> has_branch
-  branching_flags[g.num_edges()-1] = (g.m_node_flags[g.num_edges()-1] == has_branch);
+  // This will only unset the bits that are 0,0 (which means no 11, 10, or 01, which is a sibling edge)
+  // 0,0 -> !has_branch, 0,1 -> has_branch,
+  // 1,0 ->  has_branch, 1,1 -> has_branch,
+  uint64_t * words = branching_flags.data();
+  parallel_for_ranges((num_edges + 63)/64, num_threads, [&](size_t first_word, size_t last_word) {
+    for (size_t w = first_word; w < last_word; w++) {
+      size_t edge = w * 64;
+      size_t len  = std::min((size_t)64, num_edges - edge);
+      uint64_t flags = g.m_node_flags.get_int(edge, len);
+      // The last edge is whatever it is in the graph
+      // 0 -> !has_branch, 1-> has_branch
+      uint64_t next_flag = (edge + len < num_edges)? (uint64_t)g.m_node_flags[edge + len] : 0;
+      uint64_t siblings  = flags | (flags >> 1) | (next_flag << (len - 1));
+      uint64_t mask = (len == 64)? ~0ULL : (1ULL << len) - 1;
+      words[w] = (has_branch? siblings : ~siblings) & mask;
+    }
+  });
 
   // INDEGREE
   // Seems like we should iterate over all possible edges, but these will have been captured
   // by the outdegree loop above
   if (v) {
-    for (auto edge : *v) {
-      ssize_t next = g._forward(edge);
-      branching_flags[next] = has_branch;
-    }
+    parallel_for_ranges(v->size(), num_threads, [&](size_t first, size_t last) {
+      for (size_t i = first; i < last; i++) {
+        ssize_t next = g._forward((*v)[i]);
+        atomic_assign_bit(branching_flags, next, has_branch);
+      }
+    });
   }
   else {
     // This is close to the same speed as loading in vector created in the constructor
@@ -48,23 +92,89 @@ V make_branch_vector(const G& g, const vector<size_t> * v = nullptr) {
     for (symbol_type sym = 1; sym < g.sigma + 1; sym++) {
       symbol_type x = g._with_edge_flag(sym, false);      // edges without flag
       symbol_type x_minus = g._with_edge_flag(sym, true); // edges with flag
-      size_t non_minus_bound = g.m_edges.rank(g.num_edges(), x); // how many edges
-      size_t minus_bound = g.m_edges.rank(g.num_edges(), x_minus); // how many minus flags do we have?
-      for(size_t next_sel = 1; next_sel <= minus_bound; ) { // bound is inclusive
-        size_t edge = g.m_edges.select(next_sel, x_minus); // locate the appropriate pre-edge (must have minus otherwise outdegree <= 1)
-        branching_flags[g._forward(edge)] = has_branch; // follow edge and set the flag
-        size_t prev_non_flags = g.m_edges.rank(edge, x); // edge is a minus
-        size_t next_non_flag = prev_non_flags + 1; // Check that this isn't out of bounds
-        size_t next_non_flag_edge = (next_non_flag > non_minus_bound)? g.num_edges() - 1 : g.m_edges.select(next_non_flag, x);
-        // Count flags before and select to next one
-        if (next_sel == minus_bound) break;
-        next_sel = 1 + g.m_edges.rank(next_non_flag_edge, x_minus);
-      }
+      size_t non_minus_bound = g.m_edges.rank(num_edges, x); // how many edges
+      size_t minus_bound = g.m_edges.rank(num_edges, x_minus); // how many minus flags do we have?
+      // Each thread takes a range of minus flags. The first one of a range may be in the same run as the end of
+      // the previous range, in which case both set the same bit
+      parallel_for_ranges(minus_bound, num_threads, [&](size_t first, size_t last) {
+        for(size_t next_sel = first + 1; next_sel <= last; ) { // bound is inclusive
+          size_t edge = g.m_edges.select(next_sel, x_minus); // locate the appropriate pre-edge (must have minus otherwise outdegree <= 1)
+          atomic_assign_bit(branching_flags, g._forward(edge), has_branch); // follow edge and set the flag
+          size_t prev_non_flags = g.m_edges.rank(edge, x); // edge is a minus
+          size_t next_non_flag = prev_non_flags + 1; // Check that this isn't out of bounds
+          size_t next_non_flag_edge = (next_non_flag > non_minus_bound)? num_edges - 1 : g.m_edges.select(next_non_flag, x);
+          // Count flags before and select to next one
+          if (next_sel == last) break;
+          next_sel = 1 + g.m_edges.rank(next_non_flag_edge, x_minus);
+        }
+      });
     }
   }
   return V(branching_flags);
 }
 
+// Identifies the graph a stored branch vector was built for: k, the sizes, the symbol ends, every word of the node
+// flags (read 64 at a time like make_branch_vector does, and combined with xor so the result doesn't depend on
+// num_threads) and a sample of the edge symbols. Much cheaper than building the branch vector again.
+template <class G>
+uint64_t graph_fingerprint(const G & g, size_t num_threads = 1) {
+  auto mix = [](uint64_t x) {
+    x ^= x >> 33; x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+  };
+  size_t num_edges = g.num_edges();
+  uint64_t h = mix(g.k);
+  h = mix(h ^ num_edges);
+  h = mix(h ^ g.num_nodes());
+  for (size_t end : g.m_symbol_ends) h = mix(h ^ end);
+  atomic<uint64_t> flags_hash(0);
+  parallel_for_ranges((num_edges + 63)/64, num_threads, [&](size_t first_word, size_t last_word) {
+    uint64_t part = 0;
+    for (size_t w = first_word; w < last_word; w++) {
+      size_t edge = w * 64;
+      part ^= mix(mix(w) ^ g.m_node_flags.get_int(edge, std::min((size_t)64, num_edges - edge)));
+    }
+    flags_hash.fetch_xor(part, memory_order_relaxed);
+  });
+  h = mix(h ^ flags_hash.load());
+  const size_t edge_samples = 4096;
+  size_t step = std::max((size_t)1, num_edges / edge_samples);
+  for (size_t i = 0; i < num_edges; i += step) h = mix(h ^ (i << 8) ^ g.m_edges[i]);
+  return h;
+}
+
+// Writes branches with the fingerprint of g, so load_branch_vector can tell if it is for another graph
+template <class G, class V>
+bool store_branch_vector(const G & g, const V & branches, const string & filename, size_t num_threads = 1) {
+  ofstream out(filename, ios::binary | ios::trunc);
+  if (!out) return false;
+  sdsl::write_member(graph_fingerprint(g, num_threads), out);
+  branches.serialize(out);
+  return out.good();
+}
+
+// The branch vector stored in filename, if there is one for g (same fingerprint), otherwise a new one.
+// loaded (if given) is set to whether the stored one was used.
+template <bool has_branch = 1, class G, class V=sdsl::sd_vector<> >
+V load_branch_vector(const G& g, const string & filename, size_t num_threads = 1, bool * loaded = nullptr) {
+  if (loaded) *loaded = false;
+  ifstream in(filename, ios::binary);
+  if (in) {
+    uint64_t fingerprint = 0;
+    sdsl::read_member(fingerprint, in);
+    if (in && fingerprint == graph_fingerprint(g, num_threads)) {
+      V branches;
+      branches.load(in);
+      if (in && branches.size() == g.num_edges()) {
+        if (loaded) *loaded = true;
+        return branches;
+      }
+    }
+  }
+  return make_branch_vector<has_branch, G, V>(g, nullptr, num_threads);
+}
+
 template <bool has_branch, class V>
 struct _type_getter{ };
 
@@ -78,12 +188,24 @@ template <class V> struct _type_getter<1, V> {
 };
 
 
+// Edge bitmap that threads can set bits in concurrently (neighbouring edges share a word)
+class atomic_bit_vector {
+  vector<atomic<uint64_t>> m_words;
+
+  public:
+  atomic_bit_vector(size_t n) : m_words((n + 63) / 64) {
+    for (auto & w : m_words) w.store(0, memory_order_relaxed);
+  }
+
+  void set(size_t i) { m_words[i/64].fetch_or(1ULL << (i%64), memory_order_relaxed); }
+  bool operator[](size_t i) const { return (m_words[i/64].load(memory_order_relaxed) >> (i%64)) & 1; }
+};
+
 // Not technically a visitor... but a visitor pattern
 // Should change this to an edge iterator sometime
 // Or refactor it to unipath_debruijn_graph
 template <class G, const bool has_branch = 1, class B=sdsl::sd_vector<>>
 class unipath_visitor {
-  typedef sdsl::bit_vector bit_vector;
   typedef typename _type_getter<has_branch, B>::rank_type rank_type;
   typedef typename _type_getter<has_branch, B>::select_type select_type;
   typedef typename G::symbol_type symbol_type;
@@ -94,86 +216,193 @@ class unipath_visitor {
   const B   b;
   const rank_type   branch_rank;
   const select_type branch_select;
+  // number of branches each thread takes at a time
+  static const size_t chunk_size = 1024;
 
   // CTORs
-  unipath_visitor(const G& dbg) : g(dbg), b(make_branch_vector(g)), branch_rank(&b), branch_select(&b) {}
+  unipath_visitor(const G& dbg, size_t num_threads = 1)
+    : g(dbg), b(make_branch_vector<has_branch, G, B>(g, nullptr, num_threads)), branch_rank(&b), branch_select(&b) {}
   // The below may be slightly faster (if a branch vector is prebuilt at graph construction)
   unipath_visitor(const G& dbg, B & branches) : g(dbg), b(branches), branch_rank(&b), branch_select(&b) {}
-  unipath_visitor(const G& dbg, const vector<size_t> & v) : g(dbg), b(make_branch_vector(g, v)), branch_rank(&b), branch_select(&b) {}
+  unipath_visitor(const G& dbg, const vector<size_t> & v, size_t num_threads = 1)
+    : g(dbg), b(make_branch_vector<has_branch, G, B>(g, &v, num_threads)), branch_rank(&b), branch_select(&b) {}
+  // Loads the branch vector from filename (see cosmo-build --branch_vector), or builds it if there isn't one for g
+  unipath_visitor(const G& dbg, const string & filename, size_t num_threads = 1, bool * loaded = nullptr)
+    : g(dbg), b(load_branch_vector<has_branch, G, B>(g, filename, num_threads, loaded)), branch_rank(&b),
+      branch_select(&b) {}
 
+  // Visits every unipath (a path whose inner nodes have one incoming and one outgoing edge) once, calling
+  // f(thread, first_edge, last_edge, label), where label is the label of the first node followed by the symbol of
+  // each edge (so it starts with $s if the path comes from the dummy edges).
+  // Unipaths start at the branches, which num_threads threads take chunk_size at a time, so f is called
+  // concurrently (but never twice at once with the same thread index). Isolated cycles are visited after that.
   template <class F>
-  void operator()(const F & f) const {
+  void operator()(const F & f, size_t num_threads = 1) const {
+    if (g.num_edges() == 0) return;
     // Need to keep track of visited incase we have isolated cycles (e.g. plasmids)
-    bit_vector visited(g.num_edges(),0);
-    // We increment this for a faster popcount at the end (to check if we need to traverse cycles)
-    size_t     num_visited = 0;
-
-    _traverse_branches(visited, num_visited, f);
+    atomic_bit_vector visited(g.num_edges());
+    // We count these for a faster popcount at the end (to check if we need to traverse cycles)
+    size_t num_visited = _traverse_branches(visited, f, std::max((size_t)1, num_threads));
     _traverse_cycles(visited, num_visited, f);
   }
 
   template <class F>
-  void _traverse_branches(bit_vector & visited, size_t &, const F &) const {
-    // This way was just to avoid a big stack...
-    // Select to each contig split
-    for (size_t sel_idx = 1; sel_idx <= g.num_edges(); sel_idx++) {
-      size_t base = branch_select(sel_idx);
-      size_t last = g._last_sibling(base); // first not needed in this calculation
-      size_t num_siblings = last - base + 1;
-
-      // Check siblings to see if already visited (then we can skip this)
-      size_t non_visited_count = 0;
-      for (size_t sibling = 0; sibling < num_siblings; sibling++) {
-        if (!visited[base+sibling]) non_visited_count++;
-      }
-      // Skip the siblings if all are visited
-      if (non_visited_count > 0) {
-        // Loop backwards to get starting k-1 (if $ before that then we skip... and only do this if the siblings arent visited)
-
-        // loop across sibling branches to avoid selecting (access is faster) and backtracking multiple times
-        for (size_t sibling = 0; sibling < num_siblings; sibling++) {
-          // If an element is already visited, just skip it (but keep iterating)
-          if (visited[base+sibling]) continue;
-          // do unipath path traversal
+  size_t _traverse_branches(atomic_bit_vector & visited, const F & f, size_t num_threads) const {
+    size_t num_visited = 0;
+    // The all-$ node has no incoming edge, so each of its edges starts a unipath even if it isn't a branch
+    auto root = g._node_range(0);
+    for (size_t edge = get<0>(root); edge <= get<1>(root); edge++) {
+      if (b[edge] != has_branch) num_visited += _traverse_unipath(visited, f, 0, edge);
+    }
+
+    // Every other unipath starts at a branch, and no two of them share an edge, so the threads don't need to
+    // check each other's progress (only the bits they set in visited can share a word)
+    size_t num_branches = branch_rank(g.num_edges());
+    atomic<size_t> next_chunk(0);
+    atomic<size_t> total(num_visited);
+    auto work = [&](size_t thread) {
+      size_t count = 0;
+      for (size_t chunk = next_chunk++; chunk * chunk_size < num_branches; chunk = next_chunk++) {
+        size_t last = std::min(num_branches, (chunk + 1) * chunk_size);
+        for (size_t sel_idx = chunk * chunk_size + 1; sel_idx <= last; sel_idx++) {
+          count += _traverse_unipath(visited, f, thread, branch_select(sel_idx));
         }
       }
-      sel_idx += num_siblings;
+      total += count;
+    };
+    if (num_threads == 1) work(0);
+    else {
+      vector<thread> threads;
+      for (size_t t = 0; t < num_threads; t++) threads.push_back(thread(work, t));
+      for (auto & t : threads) t.join();
     }
+    return total;
   }
 
   template <class F>
-  void _traverse_cycles(bit_vector &, size_t num_visited, const F &) const {
+  void _traverse_cycles(atomic_bit_vector & visited, size_t num_visited, const F & f) const {
     // If we have visited every edge, then we have nothing left to do!
     // Anything else is a cycle (if we handled the branches before)
-    if (num_visited == g.num_edges()) return;
-
     // Just iterate over all edges that arent visited, then follow them until we get to a visited
+    for (size_t edge = 0; edge < g.num_edges() && num_visited < g.num_edges(); edge++) {
+      if (!visited[edge]) num_visited += _traverse_unipath(visited, f, 0, edge);
+    }
   }
 
-  // Assumes starting from edge straight after branch == has_branch
-  /*
+  // Follows edge until the next edge is a branch (or, for a cycle, visited). Returns the number of edges visited.
   template <class F>
-  void _traverse_unipath(bit_vector &, size_t &, const F & f, ssize_t edge) {
-    //auto visit = [&](size_t i) -> void { visited[i] = 1; num_visited++; };
-    // Check if first kmer is in set (yes)> return
+  size_t _traverse_unipath(atomic_bit_vector & visited, const F & f, size_t thread, size_t edge) const {
+    size_t first = edge;
+    size_t count = 0;
+    label_type label = g.node_label_from_edge(edge);
+    symbol_type x;
+    while (true) {
+      visited.set(edge);
+      count++;
+      ssize_t next = g._forward(edge, x);
+      // An outgoing dummy edge ($) ends the path without adding a symbol
+      if (next == -1) break;
+      label.push_back(g._map_symbol(x));
+      if (b[next] == has_branch || visited[next]) break;
+      edge = next;
+    }
+    f(thread, first, edge, label);
+    return count;
+  }
+};
+
+// Writes the unipaths from a unipath_visitor as FASTA, or as GFA (a segment for each unipath, and a link to each
+// unipath that starts where it ends). Each thread fills its own buffer, and only takes the lock to append it to the
+// stream once it is full. Segments are named by their first edge.
+// The leading $s are trimmed, and unipaths left with fewer than k symbols (so without a real edge) are skipped.
+template <class G>
+class unipath_writer {
+  typedef typename G::label_type label_type;
 
-    //if (edge == -1 || (size_t)edge >= dbg.num_edges()) return;
-    // visit elements in buffer to output first kmer
+  struct buffer_t {
+    string text;
+    size_t num_unipaths = 0;
+    size_t num_symbols  = 0;
+  };
 
-    symbol_type x;
-    while(edge != -1 && b[edge] != has_branch) { // and edge not palindrome
-      edge = g._forward(edge, x);
-      f(x);
+  public:
+  enum format_t { fasta, gfa };
+
+  private:
+  const G &        m_graph;
+  ostream &        m_out;
+  format_t         m_format;
+  size_t           m_buffer_size;
+  vector<buffer_t> m_buffers;
+  mutex            m_lock;
+
+  void _flush(buffer_t & buffer) {
+    lock_guard<mutex> guard(m_lock);
+    m_out << buffer.text;
+    buffer.text.clear();
+  }
+
+  public:
+  unipath_writer(const G & g, ostream & out, format_t format, size_t num_threads = 1, size_t buffer_size = 1 << 20)
+    : m_graph(g), m_out(out), m_format(format), m_buffer_size(buffer_size), m_buffers(std::max((size_t)1, num_threads)) {
+    if (m_format == gfa) m_out << "H\tVN:Z:1.0\n";
+  }
+
+  ~unipath_writer() { flush(); }
+
+  void operator()(size_t thread, size_t first_edge, size_t last_edge, const label_type & label) {
+    auto dollar = m_graph._map_symbol(0);
+    size_t start = 0;
+    while (start < label.size() && label[start] == dollar) start++;
+    if (label.size() - start < m_graph.k) return;
+
+    buffer_t & buffer = m_buffers[thread];
+    buffer.num_unipaths++;
+    buffer.num_symbols += label.size() - start;
+    string name = to_string(first_edge);
+    if (m_format == fasta) {
+      buffer.text += ">" + name + " length=" + to_string(label.size() - start) + "\n";
+      buffer.text.append(label.begin() + start, label.end());
+      buffer.text += "\n";
+    }
+    else {
+      buffer.text += "S\t" + name + "\t";
+      buffer.text.append(label.begin() + start, label.end());
+      buffer.text += "\n";
+      // The unipaths that start at the last node (which are only skipped if its label has a $)
+      ssize_t next = m_graph._forward(last_edge);
+      if (next != -1 && label[label.size() - (m_graph.k-1)] != dollar) {
+        auto range = m_graph._node_range(m_graph._edge_to_node(next));
+        for (size_t edge = get<0>(range); edge <= get<1>(range); edge++) {
+          if (m_graph._strip_edge_flag(m_graph.m_edges[edge]) == 0) continue;
+          buffer.text += "L\t" + name + "\t+\t" + to_string(edge) + "\t+\t" + to_string(m_graph.k-1) + "M\n";
+        }
+      }
     }
-    // Add last kmer to set
-    // Call this recursively if branch
+    if (buffer.text.size() >= m_buffer_size) _flush(buffer);
+  }
+
+  void flush() {
+    for (auto & buffer : m_buffers) if (!buffer.text.empty()) _flush(buffer);
+    m_out.flush();
+  }
+
+  size_t num_unipaths() const {
+    size_t total = 0;
+    for (auto & buffer : m_buffers) total += buffer.num_unipaths;
+    return total;
+  }
+
+  size_t num_symbols() const {
+    size_t total = 0;
+    for (auto & buffer : m_buffers) total += buffer.num_symbols;
+    return total;
   }
-  */
 };
 
 template <class G>
-unipath_visitor<G> make_unipath_visitor(const G & g) {
-  return unipath_visitor<G>(g);
+unipath_visitor<G> make_unipath_visitor(const G & g, size_t num_threads = 1) {
+  return unipath_visitor<G>(g, num_threads);
 }
 
 #endif
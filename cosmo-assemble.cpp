@@ -0,0 +1,90 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+
+#include <libgen.h> // basename
+
+#include "tclap/CmdLine.h"
+
+#include <sdsl/bit_vectors.hpp>
+#include <sdsl/wavelet_trees.hpp>
+
+#include "debruijn_graph.hpp"
+#include "algorithm.hpp"
+
+using namespace std;
+using namespace sdsl;
+
+struct parameters_t {
+  size_t num_threads = 1;
+  bool gfa = false;
+  std::string input_filename = "";
+  std::string output_prefix = "";
+};
+
+void parse_arguments(int argc, char **argv, parameters_t & params);
+void parse_arguments(int argc, char **argv, parameters_t & params)
+{
+  TCLAP::CmdLine cmd("Cosmo Copyright (c) Alex Bowe (alexbowe.com) 2014", ' ', VERSION);
+  TCLAP::UnlabeledValueArg<std::string> input_filename_arg("input",
+            ".dbg file (output from cosmo-build).", true, "", "input_file", cmd);
+  string output_short_form = "output_prefix";
+  TCLAP::ValueArg<std::string> output_prefix_arg("o", "output_prefix",
+            "Output prefix. Contigs will be written to [" + output_short_form + "].fasta (or .gfa). " +
+            "Default prefix: basename(input_file).", false, "", output_short_form, cmd);
+  size_t default_threads = std::max(1u, thread::hardware_concurrency());
+  TCLAP::ValueArg<size_t> threads_arg("t", "threads",
+            "Number of threads used to follow the unipaths. Default: number of cores (" + to_string(default_threads) + ").",
+            false, default_threads, "num_threads", cmd);
+  TCLAP::SwitchArg gfa_arg("g", "gfa",
+            "Write GFA (a segment for each contig, and the links between them) instead of FASTA.", cmd, false);
+  cmd.parse( argc, argv );
+
+  params.num_threads     = std::max((size_t)1, threads_arg.getValue());
+  params.gfa             = gfa_arg.getValue();
+  params.input_filename  = input_filename_arg.getValue();
+  params.output_prefix   = output_prefix_arg.getValue();
+}
+
+int main(int argc, char* argv[]) {
+  parameters_t p;
+  parse_arguments(argc, argv, p);
+
+  // The parameter should be const... On my computer the parameter
+  // isn't const though, yet it doesn't modify the string...
+  char * base_name = basename(const_cast<char*>(p.input_filename.c_str()));
+  string outfilename = ((p.output_prefix == "")? base_name : p.output_prefix) + (p.gfa? ".gfa" : ".fasta");
+
+  auto t1 = chrono::high_resolution_clock::now();
+  debruijn_graph<> g;
+  load_from_file(g, p.input_filename);
+  auto t2 = chrono::high_resolution_clock::now();
+  cerr << "k             : " << g.k << endl;
+  cerr << "num_nodes()   : " << g.num_nodes() << endl;
+  cerr << "num_edges()   : " << g.num_edges() << endl;
+  cerr << "load time     : " << chrono::duration_cast<chrono::milliseconds>(t2-t1).count() << " ms" << endl;
+
+  // Uses the branch vector from cosmo-build --branch_vector if there is one
+  string branch_filename = p.input_filename + ".branch";
+  bool stored_branches = false;
+  t1 = chrono::high_resolution_clock::now();
+  unipath_visitor<debruijn_graph<>> visitor(g, branch_filename, p.num_threads, &stored_branches);
+  t2 = chrono::high_resolution_clock::now();
+  cerr << "branches      : " << visitor.branch_rank(g.num_edges()) << " ("
+       << chrono::duration_cast<chrono::milliseconds>(t2-t1).count() << " ms, "
+       << ((stored_branches)? "loaded from " + branch_filename : "built") << ")" << endl;
+
+  ofstream output(outfilename);
+  typedef unipath_writer<debruijn_graph<>> writer_type;
+  writer_type writer(g, output, p.gfa? writer_type::gfa : writer_type::fasta, p.num_threads);
+  t1 = chrono::high_resolution_clock::now();
+  visitor([&](size_t thread, size_t first, size_t last, const string & label) { writer(thread, first, last, label); },
+          p.num_threads);
+  writer.flush();
+  t2 = chrono::high_resolution_clock::now();
+  double seconds = chrono::duration_cast<chrono::microseconds>(t2-t1).count() / 1e6;
+  cerr << "contigs       : " << writer.num_unipaths() << " (" << writer.num_symbols() << " bases)" << endl;
+  cerr << "assembly time : " << seconds << " s with " << p.num_threads << " threads ("
+       << writer.num_unipaths() / seconds << " contigs/s)" << endl;
+}
@@ -1,7 +1,13 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <numeric>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <functional>
 #include <libgen.h> // basename
 
 #include "tclap/CmdLine.h"
@@ -20,14 +26,43 @@
 #include "debruijn_hypergraph.hpp"
 #include "algorithm.hpp"
 #include "wt_algorithm.hpp"
+#include "mapped_graph.hpp"
+#include "edge_vector.hpp"
+#include "kmer_index.hpp"
+#include "sampled_labels.hpp"
+#include "lcs_vector.hpp"
+#include "kmer_kernels.hpp"
 
 using namespace std;
 using namespace sdsl;
 
+#ifdef VAR_ORDER
+// Counts the allocations, so that the benchmark can report how many longer and backward make per query.
+// All the (non-aligned) forms are replaced, so every new is paired with a delete of ours.
+static atomic<size_t> num_allocations(0);
+static void * counted_malloc(size_t size) {
+  num_allocations.fetch_add(1, memory_order_relaxed);
+  if (void * p = malloc(size? size : 1)) return p;
+  throw bad_alloc();
+}
+void * operator new(size_t size) { return counted_malloc(size); }
+void * operator new[](size_t size) { return counted_malloc(size); }
+void operator delete(void * p) noexcept { free(p); }
+void operator delete[](void * p) noexcept { free(p); }
+void operator delete(void * p, size_t) noexcept { free(p); }
+void operator delete[](void * p, size_t) noexcept { free(p); }
+#endif
+
 string graph_extension = ".dbg";
 string contig_extension = ".fasta";
 
 struct parameters_t {
+  bool mmap = false;
+  bool interleaved = false;
+  size_t prefix_len = 8;
+  size_t label_sample_rate = 0;
+  size_t num_convert_kmers = 0;
+  size_t num_threads = 1;
   std::string input_filename = "";
   std::string output_prefix = "";
 };
@@ -42,27 +77,114 @@ void parse_arguments(int argc, char **argv, parameters_t & params)
   TCLAP::ValueArg<std::string> output_prefix_arg("o", "output_prefix",
             "Output prefix. Contigs will be written to [" + output_short_form + "]" + contig_extension + ". " +
             "Default prefix: basename(input_file).", false, "", output_short_form, cmd);
+  TCLAP::SwitchArg mmap_arg("m", "mmap",
+            "Map the graph from [input_file].mmap (written by cosmo-build --mmap_format) instead of loading it.", cmd, false);
+  TCLAP::SwitchArg interleaved_arg("i", "interleaved",
+            "Convert the edges to an interleaved_edge_vector after loading, and benchmark that instead of the wavelet tree "
+            "(ignored with --mmap).",
+            cmd, false);
+  TCLAP::ValueArg<size_t> prefix_len_arg("p", "prefix_len",
+            "Length of the prefixes in the kmer_index used by the find_node benchmark (4^prefix_len entries).",
+            false, 8, "length", cmd);
+  TCLAP::ValueArg<size_t> label_sample_rate_arg("s", "label_sample_rate",
+            "Also time node_label with the labels of sampled nodes (see cosmo-build --label_sample_rate), built for "
+            "this rate. Default: 0 (off).", false, 0, "rate", cmd);
+  TCLAP::ValueArg<size_t> convert_kmers_arg("c", "convert_kmers",
+            "Also time the kmer conversion of cosmo-pack (the lookup table version against the kernels this CPU "
+            "supports) on this many random kmers of the graph's k. Default: 0 (off).", false, 0, "num_kmers", cmd);
+  size_t default_threads = std::max(1u, thread::hardware_concurrency());
+  TCLAP::ValueArg<size_t> threads_arg("t", "threads",
+            "Largest number of threads for the unipath traversal, which is timed for 1, 2, 4, ... threads up to this. "
+            "Default: number of cores (" + to_string(default_threads) + ").", false, default_threads, "num_threads", cmd);
   cmd.parse( argc, argv );
 
   // -d flag for decompression to original kmer biz
+  params.mmap            = mmap_arg.getValue();
+  params.interleaved     = interleaved_arg.getValue();
+  params.prefix_len      = prefix_len_arg.getValue();
+  params.label_sample_rate = label_sample_rate_arg.getValue();
+  params.num_convert_kmers = convert_kmers_arg.getValue();
+  params.num_threads     = std::max((size_t)1, threads_arg.getValue());
   params.input_filename  = input_filename_arg.getValue();
   params.output_prefix   = output_prefix_arg.getValue();
 }
 
-int main(int argc, char* argv[]) {
-  parameters_t p;
-  parse_arguments(argc, argv, p);
+#ifdef VAR_ORDER
+// Mean time (ns) of backward, shorter and longer on h, so that LCS representations can be compared on the same queries
+template <class t_hypergraph>
+array<double, 3> time_hypergraph(const t_hypergraph & h, const vector<typename t_hypergraph::node_type> & nodes,
+                                 const vector<size_t> & lower_ks, const vector<size_t> & higher_ks) {
+  array<double, 3> means{};
+  auto t1 = chrono::high_resolution_clock::now();
+  for (auto v : nodes) h.backward(v);
+  auto t2 = chrono::high_resolution_clock::now();
+  means[0] = (double)chrono::duration_cast<chrono::nanoseconds>(t2-t1).count() / nodes.size();
 
-  // The parameter should be const... On my computer the parameter
-  // isn't const though, yet it doesn't modify the string...
-  // This is still done AFTER loading the file just in case
-  char * base_name = basename(const_cast<char*>(p.input_filename.c_str()));
-  string outfilename = ((p.output_prefix == "")? base_name : p.output_prefix);
+  size_t queries = 0;
+  t1 = chrono::high_resolution_clock::now();
+  for (size_t i=0;i<nodes.size();i++) {
+    if (get<2>(nodes[i]) < lower_ks[i]) continue;
+    h.shorter(nodes[i], lower_ks[i]);
+    queries++;
+  }
+  t2 = chrono::high_resolution_clock::now();
+  means[1] = (double)chrono::duration_cast<chrono::nanoseconds>(t2-t1).count() / std::max(queries, (size_t)1);
+
+  queries = 0;
+  t1 = chrono::high_resolution_clock::now();
+  for (size_t i=0;i<nodes.size();i++) {
+    if (get<2>(nodes[i]) > higher_ks[i]) continue;
+    h.longer(nodes[i], higher_ks[i]);
+    queries++;
+  }
+  t2 = chrono::high_resolution_clock::now();
+  means[2] = (double)chrono::duration_cast<chrono::nanoseconds>(t2-t1).count() / std::max(queries, (size_t)1);
+  return means;
+}
+#endif
+
+// Converts num_kmers random kmers and adds their reverse complements as cosmo-pack does: with the lookup table version
+// (convert_representation, then reverse_complement), and with convert_kmers for each kernel this CPU supports
+template <typename kmer_t>
+void time_convert_kmers(size_t k, size_t num_kmers) {
+  boost::mt19937 rng(time(0));
+  vector<kmer_t> input(num_kmers);
+  for (auto & x : input) {
+    for (size_t b = 0; b < sizeof(kmer_t)/sizeof(uint64_t); b++) ((uint64_t*)&x)[b] = ((uint64_t)rng() << 32) | rng();
+    if (k * NT_WIDTH < bitwidth<kmer_t>::width) x = x & ~(~kmer_t(0) << (k * NT_WIDTH));
+  }
 
-  // TO LOAD:
-  debruijn_graph<> g;
-  load_from_file(g, p.input_filename);
+  vector<kmer_t> table(2 * num_kmers);
+  // best of 3, in ns per kmer
+  auto time_ns = [&](function<void()> f) {
+    double best = 0;
+    for (size_t rep = 0; rep < 3; rep++) {
+      copy(input.begin(), input.end(), table.begin());
+      auto t1 = chrono::high_resolution_clock::now();
+      f();
+      auto t2 = chrono::high_resolution_clock::now();
+      double ns = (double)chrono::duration_cast<chrono::nanoseconds>(t2-t1).count() / num_kmers;
+      if (rep == 0 || ns < best) best = ns;
+    }
+    return best;
+  };
+
+  double lut = time_ns([&]() {
+    convert_representation(&table[0], &table[0], num_kmers);
+    transform(table.begin(), table.begin() + num_kmers, table.begin() + num_kmers, reverse_complement<kmer_t>(k));
+  });
+  vector<kmer_t> expected(table);
+  cerr << "convert lut   : " << lut << " ns/kmer" << endl;
+  for (kernel_isa isa : {isa_scalar, isa_ssse3, isa_avx2}) {
+    if (isa > best_kernel_isa_for<kmer_t>()) break;
+    double ns = time_ns([&]() { convert_kmers(&table[0], &table[0], num_kmers, &table[num_kmers], k, isa); });
+    cerr << "convert " << kernel_isa_name(isa) << " : " << ns << " ns/kmer (" << lut / ns << "x"
+         << ((table == expected)? "" : ", DIFFERENT") << ")" << endl;
+  }
+}
 
+template <class t_graph>
+void benchmark(const t_graph & g, const parameters_t & p) {
   cerr << "k             : " << g.k << endl;
   cerr << "num_nodes()   : " << g.num_nodes() << endl;
   cerr << "num_edges()   : " << g.num_edges() << endl;
@@ -78,8 +200,8 @@ int main(int argc, char* argv[]) {
   cerr << "LCS size      : " << size_in_mega_bytes(lcs) << " MB" << endl;
   cerr << "LCS bits/edge : " << bits_per_element(lcs) << " Bits" << endl;
 
-  typedef debruijn_hypergraph<> dbh;
-  typedef dbh::node_type node_type;
+  typedef debruijn_hypergraph<t_graph> dbh;
+  typedef typename dbh::node_type node_type;
   dbh h(g, lcs);
   #endif
 
@@ -125,7 +247,7 @@ int main(int argc, char* argv[]) {
     query_varnodes[i] = h.shorter(query_varnodes[i], query_ks[i]);
   }
   #else
-  vector<debruijn_graph<>::node_type> query_rangenodes;
+  vector<typename t_graph::node_type> query_rangenodes;
   //transform(query_nodes.begin(), query_nodes.end(), query_varnodes.begin(),[&](size_t v){ return h.get_node(v); });
   for (auto u:query_nodes) {
     query_rangenodes.push_back(g.get_node(u));
@@ -163,6 +285,119 @@ int main(int argc, char* argv[]) {
   dur = chrono::duration_cast<unit>(t2-t1).count();
   //cerr << "lastchar total : " << dur << " ns" <<endl;
   cerr << "lastchar mean : " << (double)dur/num_queries << unit_s <<endl;
+
+  // Throughput of the batched queries against the single query loops
+  vector<size_t> query_edges;
+  for (auto v : query_rangenodes) query_edges.push_back(get<0>(v));
+  vector<typename t_graph::symbol_type> query_symbols(query_syms.begin(), query_syms.end());
+  vector<ssize_t> fwd_out(num_queries);
+  vector<size_t>  bwd_out(num_queries);
+  auto report_batch = [&](const string & name, double single, double batch) {
+    cerr << name << " : " << single/num_queries << " -> " << batch/num_queries << unit_s
+         << " (" << single/batch << "x)" << endl;
+  };
+
+  t1 = chrono::high_resolution_clock::now();
+  for (size_t i=0;i<(size_t)num_queries;i++) { fwd_out[i] = g._forward(query_edges[i]); }
+  t2 = chrono::high_resolution_clock::now();
+  auto single = chrono::duration_cast<unit>(t2-t1).count();
+  t1 = chrono::high_resolution_clock::now();
+  g.forward_batch(&query_edges[0], num_queries, &fwd_out[0]);
+  t2 = chrono::high_resolution_clock::now();
+  report_batch("_forward batch ", single, chrono::duration_cast<unit>(t2-t1).count());
+
+  t1 = chrono::high_resolution_clock::now();
+  for (size_t i=0;i<(size_t)num_queries;i++) { bwd_out[i] = g._backward(query_edges[i]); }
+  t2 = chrono::high_resolution_clock::now();
+  single = chrono::duration_cast<unit>(t2-t1).count();
+  t1 = chrono::high_resolution_clock::now();
+  g.backward_batch(&query_edges[0], num_queries, &bwd_out[0]);
+  t2 = chrono::high_resolution_clock::now();
+  report_batch("_backward batch", single, chrono::duration_cast<unit>(t2-t1).count());
+
+  t1 = chrono::high_resolution_clock::now();
+  for (size_t i=0;i<(size_t)num_queries;i++) { fwd_out[i] = g.interval_node_outgoing(query_rangenodes[i], query_symbols[i]); }
+  t2 = chrono::high_resolution_clock::now();
+  single = chrono::duration_cast<unit>(t2-t1).count();
+  t1 = chrono::high_resolution_clock::now();
+  g.outgoing_batch(&query_rangenodes[0], &query_symbols[0], num_queries, &fwd_out[0]);
+  t2 = chrono::high_resolution_clock::now();
+  report_batch("outgoing batch ", single, chrono::duration_cast<unit>(t2-t1).count());
+
+  // string -> node, for labels that are in the graph
+  vector<typename t_graph::label_type> query_labels;
+  for (auto u : query_nodes) query_labels.push_back(g.node_label(u));
+  t1 = chrono::high_resolution_clock::now();
+  for (size_t i=0;i<(size_t)num_queries;i++) { fwd_out[i] = g.find_node(query_labels[i]); }
+  t2 = chrono::high_resolution_clock::now();
+  single = chrono::duration_cast<unit>(t2-t1).count();
+  cerr << "find_node mean : " << (double)single/num_queries << unit_s << endl;
+  t1 = chrono::high_resolution_clock::now();
+  g.find_nodes(&query_labels[0], num_queries, &fwd_out[0]);
+  t2 = chrono::high_resolution_clock::now();
+  report_batch("find_node batch", single, chrono::duration_cast<unit>(t2-t1).count());
+
+  t1 = chrono::high_resolution_clock::now();
+  kmer_index<t_graph> index(g, p.prefix_len);
+  t2 = chrono::high_resolution_clock::now();
+  cerr << "kmer_index    : " << index.prefix_len() << " symbols, " << index.size_in_bytes()/(1024.0*1024.0) << " MB, built in "
+       << chrono::duration_cast<chrono::milliseconds>(t2-t1).count() << " ms" << endl;
+  t1 = chrono::high_resolution_clock::now();
+  for (size_t i=0;i<(size_t)num_queries;i++) { fwd_out[i] = index.find_node(query_labels[i]); }
+  t2 = chrono::high_resolution_clock::now();
+  report_batch("find_node index", single, chrono::duration_cast<unit>(t2-t1).count());
+  t1 = chrono::high_resolution_clock::now();
+  index.find_nodes(&query_labels[0], num_queries, &fwd_out[0]);
+  t2 = chrono::high_resolution_clock::now();
+  report_batch("index batch    ", single, chrono::duration_cast<unit>(t2-t1).count());
+
+  // node -> string, walking back k-1 steps or stopping at a sampled label
+  t1 = chrono::high_resolution_clock::now();
+  for (auto u : query_nodes) { query_labels[0] = g.node_label(u); }
+  t2 = chrono::high_resolution_clock::now();
+  single = chrono::duration_cast<unit>(t2-t1).count();
+  cerr << "node_label mean : " << (double)single/num_queries << unit_s << endl;
+  if (p.label_sample_rate > 0) {
+    t1 = chrono::high_resolution_clock::now();
+    sampled_node_labels<t_graph> labels(g, p.label_sample_rate);
+    t2 = chrono::high_resolution_clock::now();
+    cerr << "sampled labels : " << labels.num_samples() << " samples, " << size_in_mega_bytes(labels) << " MB ("
+         << size_in_bytes(labels) * 8.0 / g.num_nodes() << " bits/node), built in "
+         << chrono::duration_cast<chrono::milliseconds>(t2-t1).count() << " ms" << endl;
+    t1 = chrono::high_resolution_clock::now();
+    for (auto u : query_nodes) { query_labels[0] = labels.node_label(g, u); }
+    t2 = chrono::high_resolution_clock::now();
+    report_batch("node_label sampled", single, chrono::duration_cast<unit>(t2-t1).count());
+  }
+
+  // branch vector, for 1, 2, 4, ... threads
+  vector<size_t> thread_counts;
+  for (size_t threads = 1; threads < p.num_threads; threads *= 2) thread_counts.push_back(threads);
+  thread_counts.push_back(p.num_threads);
+  sd_vector<> branches;
+  double base_seconds = 0;
+  for (size_t threads : thread_counts) {
+    t1 = chrono::high_resolution_clock::now();
+    branches = make_branch_vector(g, nullptr, threads);
+    t2 = chrono::high_resolution_clock::now();
+    double seconds = chrono::duration_cast<chrono::microseconds>(t2-t1).count() / 1e6;
+    if (threads == 1) base_seconds = seconds;
+    cerr << "branch vector (" << threads << "t) : " << seconds * 1000 << " ms (" << base_seconds / seconds << "x)" << endl;
+  }
+
+  // unipaths (contigs), counted rather than written
+  unipath_visitor<t_graph> visitor(g, branches);
+  for (size_t threads : thread_counts) {
+    vector<size_t> counts(threads, 0);
+    t1 = chrono::high_resolution_clock::now();
+    visitor([&](size_t thread, size_t, size_t, const typename t_graph::label_type &) { counts[thread]++; }, threads);
+    t2 = chrono::high_resolution_clock::now();
+    double seconds = chrono::duration_cast<chrono::microseconds>(t2-t1).count() / 1e6;
+    if (threads == 1) base_seconds = seconds;
+    size_t num_unipaths = accumulate(counts.begin(), counts.end(), (size_t)0);
+    cerr << "unipaths (" << threads << "t) : " << num_unipaths << " in " << seconds << " s (" << num_unipaths / seconds
+         << " per s, " << base_seconds / seconds << "x)" << endl;
+  }
   #else
   auto t1 = chrono::high_resolution_clock::now();
   // backward
@@ -205,7 +440,7 @@ int main(int argc, char* argv[]) {
         skipped++;
         continue;
       }
-      h.longer(v, k);
+      h.shorter(v, k);
     }
     t2 = chrono::high_resolution_clock::now();
     dur = chrono::duration_cast<unit>(t2-t1).count();
@@ -252,7 +487,116 @@ int main(int argc, char* argv[]) {
   dur = chrono::duration_cast<unit>(t2-t1).count();
   //cerr << "maxlen(v,*) total : " << dur << " ns" <<endl;
   cerr << "maxlen* mean  : " << (double)dur/num_queries << unit_s <<endl;
+
+  // prev_lte/next_lte (as used by shorter) one position at a time and in a batch
+  size_t lte_k = (min_k + g.k-1)/2;
+  vector<size_t> lte_pos(num_queries), lte_out(num_queries);
+  for (size_t i=0;i<(size_t)num_queries;i++) lte_pos[i] = get<0>(query_varnodes[i]) + 1;
+  auto report_batch = [&](const string & name, double single, double batch) {
+    cerr << name << " : " << single/num_queries << " -> " << batch/num_queries << unit_s
+         << " (" << single/batch << "x)" << endl;
+  };
+  t1 = chrono::high_resolution_clock::now();
+  for (size_t i=0;i<(size_t)num_queries;i++) { lte_out[i] = prev_lte(lcs, lte_pos[i], lte_k); }
+  t2 = chrono::high_resolution_clock::now();
+  auto single = chrono::duration_cast<unit>(t2-t1).count();
+  t1 = chrono::high_resolution_clock::now();
+  prev_lte_batch(lcs, &lte_pos[0], num_queries, lte_k, &lte_out[0]);
+  t2 = chrono::high_resolution_clock::now();
+  report_batch("prev_lte batch", single, chrono::duration_cast<unit>(t2-t1).count());
+
+  t1 = chrono::high_resolution_clock::now();
+  for (size_t i=0;i<(size_t)num_queries;i++) { lte_out[i] = next_lte(lcs, lte_pos[i], lte_k); }
+  t2 = chrono::high_resolution_clock::now();
+  single = chrono::duration_cast<unit>(t2-t1).count();
+  t1 = chrono::high_resolution_clock::now();
+  next_lte_batch(lcs, &lte_pos[0], num_queries, lte_k, &lte_out[0]);
+  t2 = chrono::high_resolution_clock::now();
+  report_batch("next_lte batch", single, chrono::duration_cast<unit>(t2-t1).count());
+
+  // The same queries with the RMQ alternative to the LCS wavelet tree (written by cosmo-build as .lcs.rmq)
+  rmq_lcs_vector lcs_rmq;
+  if (load_from_file(lcs_rmq, p.input_filename + ".lcs.rmq")) {
+    cerr << "LCS RMQ size  : " << size_in_mega_bytes(lcs_rmq) << " MB" << endl;
+    cerr << "LCS RMQ b/edge: " << bits_per_element(lcs_rmq) << " Bits" << endl;
+    debruijn_hypergraph<t_graph, rmq_lcs_vector> h_rmq(g, lcs_rmq);
+    auto wt_means  = time_hypergraph(h, query_varnodes, lower_ks, higher_ks);
+    auto rmq_means = time_hypergraph(h_rmq, query_varnodes, lower_ks, higher_ks);
+    const string names[] = {"backward", "shorter ", "longer  "};
+    for (size_t q = 0; q < 3; q++) {
+      cerr << names[q] << " wt -> rmq : " << wt_means[q] << " -> " << rmq_means[q] << unit_s
+           << " (" << wt_means[q]/rmq_means[q] << "x)" << endl;
+    }
+  }
+
+  // longer and backward build vectors, longer_nodes and backward_nodes find the nodes as they are iterated
+  size_t checksum = 0;
+  auto time_queries = [&](const string & name, const function<void(size_t)> & query) {
+    size_t allocations = num_allocations;
+    auto start = chrono::high_resolution_clock::now();
+    for (size_t i=0;i<(size_t)num_queries;i++) query(i);
+    auto end = chrono::high_resolution_clock::now();
+    cerr << name << " : " << (double)chrono::duration_cast<unit>(end-start).count()/num_queries << unit_s << ", "
+         << (double)(num_allocations - allocations)/num_queries << " allocations/query" << endl;
+  };
+  auto longer_k = [&](size_t i) { return std::max(get<2>(query_varnodes[i]), higher_ks[i]); };
+  time_queries("longer        ", [&](size_t i) {
+    for (auto u : h.longer(query_varnodes[i], longer_k(i))) checksum += get<0>(u);
+  });
+  time_queries("longer_nodes  ", [&](size_t i) {
+    for (auto u : h.longer_nodes(query_varnodes[i], longer_k(i))) checksum += get<0>(u);
+  });
+  time_queries("backward      ", [&](size_t i) {
+    for (auto u : h.backward(query_varnodes[i])) checksum += get<0>(u);
+  });
+  time_queries("backward_nodes", [&](size_t i) {
+    for (auto u : h.backward_nodes(query_varnodes[i])) checksum += get<0>(u);
+  });
+  time_queries("first backward", [&](size_t i) {
+    auto nodes = h.backward_nodes(query_varnodes[i]);
+    auto first = nodes.begin();
+    if (first != nodes.end()) checksum += get<0>(*first);
+  });
+  if (checksum == 1) cerr << endl; // keeps the loops
   #endif
 
+  if (p.num_convert_kmers > 0) {
+    if (g.k * NT_WIDTH <= bitwidth<uint64_t>::width) time_convert_kmers<uint64_t>(g.k, p.num_convert_kmers);
+    else if (g.k * NT_WIDTH <= bitwidth<uint128_t>::width) time_convert_kmers<uint128_t>(g.k, p.num_convert_kmers);
+    else if (g.k * NT_WIDTH <= bitwidth<uint192_t>::width) time_convert_kmers<uint192_t>(g.k, p.num_convert_kmers);
+    else time_convert_kmers<uint256_t>(g.k, p.num_convert_kmers);
+  }
 }
 
+int main(int argc, char* argv[]) {
+  parameters_t p;
+  parse_arguments(argc, argv, p);
+
+  // The parameter should be const... On my computer the parameter
+  // isn't const though, yet it doesn't modify the string...
+  // This is still done AFTER loading the file just in case
+  char * base_name = basename(const_cast<char*>(p.input_filename.c_str()));
+  string outfilename = ((p.output_prefix == "")? base_name : p.output_prefix);
+
+  auto t1 = chrono::high_resolution_clock::now();
+  if (p.mmap) {
+    mapped_debruijn_graph g = map_graph_from_file(p.input_filename + ".mmap");
+    auto t2 = chrono::high_resolution_clock::now();
+    cerr << "load time     : " << chrono::duration_cast<chrono::microseconds>(t2-t1).count() << " us (mapped)" << endl;
+    benchmark(g, p);
+  }
+  else {
+    // TO LOAD:
+    debruijn_graph<> g;
+    load_from_file(g, p.input_filename);
+    auto t2 = chrono::high_resolution_clock::now();
+    cerr << "load time     : " << chrono::duration_cast<chrono::microseconds>(t2-t1).count() << " us" << endl;
+    if (p.interleaved) {
+      interleaved_edge_vector<> edges(g.num_edges(), [&](size_t i) { return g.m_edges[i]; });
+      interleaved_debruijn_graph ig = interleaved_debruijn_graph::load_from_components(g.k, g.m_node_flags, edges,
+                                                                                       g.m_symbol_ends, g.m_alphabet);
+      benchmark(ig, p);
+    }
+    else benchmark(g, p);
+  }
+}
@@ -1,5 +1,7 @@
 #include <iostream>
 #include <fstream>
+#include <chrono>
+#include <thread>
 
 #include <libgen.h> // basename
 
@@ -11,6 +13,9 @@
 #include "io.hpp"
 #include "debruijn_graph.hpp"
 #include "algorithm.hpp"
+#include "mapped_graph.hpp"
+#include "sampled_labels.hpp"
+#include "lcs_vector.hpp"
 
 using namespace std;
 using namespace sdsl;
@@ -18,6 +23,12 @@ using namespace sdsl;
 string extension = ".dbg";
 
 struct parameters_t {
+  bool mmap_format = false;
+  size_t label_sample_rate = 0;
+  bool branch_vector = false;
+  size_t num_threads = 1;
+  vector<size_t> lcs_levels;
+  size_t lcs_threshold = 0;
   std::string input_filename = "";
   std::string output_prefix = "";
 };
@@ -32,8 +43,41 @@ void parse_arguments(int argc, char **argv, parameters_t & params)
   TCLAP::ValueArg<std::string> output_prefix_arg("o", "output_prefix",
             "Output prefix. Graph will be written to [" + output_short_form + "]" + extension + ". " +
             "Default prefix: basename(input_file).", false, "", output_short_form, cmd);
+  TCLAP::SwitchArg mmap_format_arg("m", "mmap_format",
+            "Also write the graph to [" + output_short_form + "]" + extension + ".mmap, which can be memory mapped "
+            "instead of loaded.", cmd, false);
+  TCLAP::ValueArg<size_t> label_sample_rate_arg("s", "label_sample_rate",
+            "Also write the labels of sampled nodes to [" + output_short_form + "]" + extension + ".labels, so that "
+            "any node label can be recovered in at most this many backward steps instead of k-1. Roughly one node in "
+            "rate+1 is sampled, at k-1 symbols each. Default: 0 (off).", false, 0, "rate", cmd);
+  TCLAP::SwitchArg branch_vector_arg("b", "branch_vector",
+            "Also write the branch vector (which edges start a contig) to [" + output_short_form + "]" + extension +
+            ".branch, which cosmo-assemble loads instead of building it again.", cmd, false);
+  size_t default_threads = std::max(1u, thread::hardware_concurrency());
+  TCLAP::ValueArg<size_t> threads_arg("t", "threads",
+            "Number of threads used to build the branch vector. Default: number of cores (" + to_string(default_threads) + ").",
+            false, default_threads, "num_threads", cmd);
+  #ifdef VAR_ORDER
+  TCLAP::MultiArg<size_t> lcs_levels_arg("q", "lcs_level",
+            "Quantize the LCS values: each one becomes the largest of these levels that is <= it (or 0). Repeat the "
+            "option for each level. Default: keep the values as they are.", false, "level", cmd);
+  TCLAP::ValueArg<size_t> lcs_threshold_arg("", "lcs_threshold",
+            "Set the LCS values below this one to 0 (instead of --lcs_level).", false, 0, "threshold", cmd);
+  #endif
   cmd.parse( argc, argv );
 
+  params.mmap_format     = mmap_format_arg.getValue();
+  params.label_sample_rate = label_sample_rate_arg.getValue();
+  params.branch_vector   = branch_vector_arg.getValue();
+  params.num_threads     = std::max((size_t)1, threads_arg.getValue());
+  #ifdef VAR_ORDER
+  params.lcs_levels      = lcs_levels_arg.getValue();
+  params.lcs_threshold   = lcs_threshold_arg.getValue();
+  if (!params.lcs_levels.empty() && params.lcs_threshold > 0) {
+    fprintf(stderr, "ERROR: --lcs_level and --lcs_threshold can't be used together.\n");
+    exit(EXIT_FAILURE);
+  }
+  #endif
   params.input_filename  = input_filename_arg.getValue();
   params.output_prefix   = output_prefix_arg.getValue();
 }
@@ -42,10 +86,18 @@ int main(int argc, char* argv[]) {
   parameters_t p;
   parse_arguments(argc, argv, p);
 
+  // The parameter should be const... On my computer the parameter
+  // isn't const though, yet it doesn't modify the string...
+  char * base_name = basename(const_cast<char*>(p.input_filename.c_str()));
+  string outfilename = ((p.output_prefix == "")? base_name : p.output_prefix) + extension;
+
   ifstream input(p.input_filename, ios::in|ios::binary|ios::ate);
-  // Can add this to save a couple seconds off traversal - not really worth it.
-  //vector<size_t> minus_positions;
-  debruijn_graph<> dbg = debruijn_graph<>::load_from_packed_edges(input, "$ACGT"/*, &minus_positions*/);
+  // Saves the select over the minus flags when building the branch vector
+  vector<size_t> minus_positions;
+  // The edges are streamed through a temporary file next to the output, to keep the memory down
+  debruijn_graph<> dbg = debruijn_graph<>::load_from_packed_edges(input, "$ACGT",
+                                                                  (p.branch_vector)? &minus_positions : nullptr,
+                                                                  outfilename + ".edges.tmp");
   input.close();
 
   cerr << "k             : " << dbg.k << endl;
@@ -54,20 +106,42 @@ int main(int argc, char* argv[]) {
   cerr << "Total size    : " << size_in_mega_bytes(dbg) << " MB" << endl;
   cerr << "Bits per edge : " << bits_per_element(dbg) << " Bits" << endl;
 
-
-  // The parameter should be const... On my computer the parameter
-  // isn't const though, yet it doesn't modify the string...
-  // This is still done AFTER loading the file just in case
-  char * base_name = basename(const_cast<char*>(p.input_filename.c_str()));
-  string outfilename = ((p.output_prefix == "")? base_name : p.output_prefix) + extension;
   store_to_file(dbg, outfilename);
+  if (p.mmap_format) store_mapped_to_file(dbg, outfilename + ".mmap");
+
+  if (p.label_sample_rate > 0) {
+    sampled_node_labels<> labels(dbg, p.label_sample_rate);
+    cerr << "Label samples : " << labels.num_samples() << " (every " << p.label_sample_rate << " steps)" << endl;
+    cerr << "Labels size   : " << size_in_mega_bytes(labels) << " MB" << endl;
+    cerr << "Labels b/node : " << size_in_bytes(labels) * 8.0 / dbg.num_nodes() << " Bits" << endl;
+    store_to_file(labels, outfilename + ".labels");
+  }
+
+  if (p.branch_vector) {
+    auto t1 = chrono::high_resolution_clock::now();
+    sd_vector<> branches = make_branch_vector(dbg, &minus_positions, p.num_threads);
+    auto t2 = chrono::high_resolution_clock::now();
+    vector<size_t>().swap(minus_positions);
+    cerr << "Branch vector : " << size_in_mega_bytes(branches) << " MB, built in "
+         << chrono::duration_cast<chrono::milliseconds>(t2-t1).count() << " ms" << endl;
+    store_branch_vector(dbg, branches, outfilename + ".branch", p.num_threads);
+  }
 
   #ifdef VAR_ORDER
+  // cosmo-pack writes the LCS values to [input].lcs, and they are quantized as they are read
+  int_vector<> lcs_values = load_lcs_from_file(p.input_filename + ".lcs", dbg.k,
+                                               lcs_quantizer(p.lcs_levels, p.lcs_threshold));
   wt_int<rrr_vector<63>> lcs;
-  construct(lcs, base_name + string(".lcs"), 1);
+  construct_im(lcs, lcs_values);
   cerr << "LCS size      : " << size_in_mega_bytes(lcs) << " MB" << endl;
   cerr << "LCS bits/edge : " << bits_per_element(lcs) << " Bits" << endl;
   store_to_file(lcs, outfilename + ".lcs.wt");
+  // The RMQ alternative to the wavelet tree (rmq_lcs_vector), for debruijn_hypergraph<debruijn_graph<>, rmq_lcs_vector>
+  rmq_lcs_vector lcs_rmq(lcs_values);
+  int_vector<>().swap(lcs_values);
+  cerr << "LCS RMQ size  : " << size_in_mega_bytes(lcs_rmq) << " MB" << endl;
+  cerr << "LCS RMQ b/edge: " << bits_per_element(lcs_rmq) << " Bits" << endl;
+  store_to_file(lcs_rmq, outfilename + ".lcs.rmq");
   // TODO: Write compressed LCS
   #endif
 }
@@ -4,6 +4,8 @@
 #include <iostream>
 //#include <algorithm>
 #include <utility>
+#include <chrono>
+#include <thread>
 
 // TCLAP
 #include "tclap/CmdLine.h"
@@ -28,6 +30,8 @@
 #include "io.hpp"
 #include "sort.hpp"
 #include "dummies.hpp"
+#include "pack.hpp"
+#include "reads.hpp"
 #include "debug.h"
 
 
@@ -36,115 +40,17 @@ using namespace boost::adaptors;
 
 const static string extension = ".packed";
 
-template <typename kmer_t, class Visitor>
-void convert(kmer_t * kmers, size_t num_kmers, const uint32_t k, Visitor visit) {
-  // Convert the nucleotide representation to allow tricks
-  convert_representation(kmers, kmers, num_kmers);
-
-  // Append reverse complements
-  #ifdef ADD_REVCOMPS
-  size_t revcomp_factor = 2;
-  transform(kmers, kmers + num_kmers, kmers + num_kmers, reverse_complement<kmer_t>(k));
-  #else
-  size_t revcomp_factor = 1;
-  #endif
-
-  // NOTE: There might be a way to do this recursively using counting (and not two tables)
-  // After the sorting phase, Table A will in <colex(node), edge> order (as required for output)
-  // and Table B will be in colex(row) order. Having both tables is helpful for detecting the missing dummy
-  // edges with a simple O(N) merge-join algorithm.
-  // NOTE: THESE SHOULD NOT BE FREED (the kmers array is freed by the caller)
-  kmer_t * table_a = kmers;
-  kmer_t * table_b = kmers + num_kmers * revcomp_factor; // x2 because of reverse complements
-  // Sort by last column to do the edge-sorted part of our <colex(node), edge>-sorted table
-  colex_partial_radix_sort<DNA_RADIX>(table_a, table_b, num_kmers * revcomp_factor, 0, 1,
-                                      &table_a, &table_b, get_nt_functor<kmer_t>());
-  // Sort from k to last column (not k to 1 - we need to sort by the edge column a second time to get colex(row) table)
-  // Note: The output names are swapped (we want table a to be the primary table and b to be aux), because our desired
-  // result is the second last iteration (<colex(node), edge>-sorted) but we still have use for the last iteration (colex(row)-sorted).
-  // Hence, table_b is the output sorted from [hi-1 to lo], and table_a is the 2nd last iter sorted from (hi-1 to lo]
-  colex_partial_radix_sort<DNA_RADIX>(table_a, table_b, num_kmers * revcomp_factor, 0, k,
-                                      &table_b, &table_a, get_nt_functor<kmer_t>());
-
-  // outgoing dummy edges are output in correct order while merging, whereas incoming dummy edges are not in the correct
-  // position, but are sorted relatively, hence can be merged if collected in a previous pass
-  // count dummies (to allocate space)
-  size_t num_incoming_dummies = count_incoming_dummy_edges(table_a, table_b, num_kmers*revcomp_factor, k);
-  TRACE("num_incoming_dummies: %zu\n", num_incoming_dummies);
-  // allocate space for dummies -> we need to generate all the $-prefixed dummies, so can't just use an iterator for the
-  // incoming dummies (the few that we get from the set_difference are the ones we apply $x[0:-1] to, so we need (k-1) more for each
-  // (to make $...$x[0])... times two because we need to radix sort these bitches.
-  #ifdef ALL_DUMMIES
-  size_t all_dummies_factor = (k-1);
-  size_t dummy_table_factor = 2;
-  #else
-  size_t all_dummies_factor = 1;
-  size_t dummy_table_factor = 1;
-  #endif
-  // Don't have to alloc if we aren't preparing all dummies, but this option is only used for testing. Usually we want them
-  kmer_t * incoming_dummies = (kmer_t*) malloc(num_incoming_dummies*all_dummies_factor*dummy_table_factor*sizeof(kmer_t));
-  if (!incoming_dummies) {
-    cerr << "Error allocating space for incoming dummies" << endl;
-    exit(1);
-  }
-  // We store lengths because the prefix before the <length> symbols on the right will all be $ signs
-  // this is a cheaper way than storing all symbols in 3 bits instead (although it means we need a varlen radix sort)
-  uint8_t * incoming_dummy_lengths = (uint8_t*) malloc(num_incoming_dummies*all_dummies_factor*dummy_table_factor*sizeof(uint8_t));
-  if (!incoming_dummy_lengths) {
-    cerr << "Error allocating space for incoming dummy lengths" << endl;
-    exit(1);
-  }
-  // extract dummies
-  find_incoming_dummy_edges(table_a, table_b, num_kmers*revcomp_factor, k, incoming_dummies);
-  // add extra dummies
-  #ifdef ALL_DUMMIES
-  prepare_incoming_dummy_edges(incoming_dummies, incoming_dummy_lengths, num_incoming_dummies, k-1);
-  #else
-  // Just set the lengths for merging
-  memset(incoming_dummy_lengths, k-1, num_incoming_dummies);
-  #endif
-
-  kmer_t * dummies_a = incoming_dummies;
-  uint8_t * lengths_a = incoming_dummy_lengths;
-  // sort dummies (varlen radix)
-  // dont need to sort if not adding the extras, since already sorted
-  #ifdef ALL_DUMMIES
-  kmer_t * dummies_b = incoming_dummies + num_incoming_dummies * (k-1);
-  uint8_t * lengths_b = incoming_dummy_lengths + num_incoming_dummies * (k-1);
-  colex_partial_radix_sort<DNA_RADIX>(dummies_a, dummies_b, num_incoming_dummies*(k-1), 0, 1,
-                                      &dummies_a, &dummies_b, get_nt_functor<kmer_t>(),
-                                      lengths_a, lengths_b, &lengths_a, &lengths_b);
-  // Don't need the last iteration (i.e. dont need to go to 0) since we arent doing a set difference like above
-  colex_partial_radix_sort<DNA_RADIX>(dummies_a, dummies_b, num_incoming_dummies*(k-1), 1, k-1,
-                                      &dummies_a, &dummies_b, get_nt_functor<kmer_t>(),
-                                      lengths_a, lengths_b, &lengths_a, &lengths_b);
-  #endif
-  merge_dummies(table_a, table_b, num_kmers*revcomp_factor, k,
-                dummies_a, num_incoming_dummies*all_dummies_factor,
-                lengths_a,
-                // edge_tag needed to distinguish between dummy out edge or not...
-                [=](edge_tag tag, const kmer_t & x, const uint32_t x_k, size_t first_start_node, bool first_end_node) {
-                  // TODO: this should be factored into a class that prints full kmers in ascii
-                  // then add a --full option
-                  #ifdef VERBOSE // print each kmer to stderr for testing
-                  if (tag == out_dummy)
-                    cerr << kmer_to_string(get_start_node(x), k-1, k-1) << "$";
-                  else
-                    cerr << kmer_to_string(x, k, x_k);
-                  cerr << " " << first_start_node << " " << first_end_node << endl;
-                  #endif
-                  visit(tag, x, x_k, first_start_node, first_end_node);
-                });
-  // TODO: impl external-merge (for large input. Read in chunk, sort, write temp, ext merge + add dummies to temp, 3-way-merge)
-  // TODO: use SSE instructions or CUDA if available (very far horizon)
-
-  free(incoming_dummies);
-  free(incoming_dummy_lengths);
-}
-
 typedef struct p
 {
     //bool ascii = false;
+    bool use_mmap = false;
+    size_t num_threads = 1;
+    size_t nts_per_pass = 1;
+    size_t mem_budget = 0; // bytes, 0 -> no limit
+    bool low_mem = false;
+    bool generic_k = false;
+    uint32_t kmer_size = 0; // 0 -> the input is a DSK file
+    size_t min_count = 1;
     std::string input_filename = "";
     std::string output_prefix = "";
 } parameters_t;
@@ -159,89 +65,152 @@ void parse_arguments(int argc, char **argv, parameters_t & params)
             cmd, false);
   */
   TCLAP::UnlabeledValueArg<std::string> input_filename_arg("input",
-            "Input file. Currently only supports DSK's binary format (for k<=64).", true, "", "input_file", cmd);
+            "Input file: DSK's binary format (for k<=128), or FASTA/FASTQ reads (optionally gzipped) with --kmer_size.",
+            true, "", "input_file", cmd);
   string output_short_form = "output_prefix";
   TCLAP::ValueArg<std::string> output_prefix_arg("o", "output_prefix",
             "Output prefix. Results will be written to [" + output_short_form + "]" + extension + ". " +
             "Default prefix: basename(input_file).", false, "", output_short_form, cmd);
+  TCLAP::SwitchArg mmap_arg("m", "mmap",
+            "Memory map the input file and extract kmers in parallel (faster for large files).", cmd, false);
+  size_t default_threads = std::max(1u, thread::hardware_concurrency());
+  TCLAP::ValueArg<size_t> threads_arg("t", "threads",
+            "Number of threads used to read and sort the kmers. Default: number of cores (" + to_string(default_threads) + ").",
+            false, default_threads, "num_threads", cmd);
+  TCLAP::ValueArg<size_t> nts_per_pass_arg("w", "nts_per_pass",
+            "Number of nucleotides to sort per radix pass (1, 4 or 8). Wider passes make fewer passes over memory. "
+            "With --low_mem, whose in place sort always takes 4 nucleotides per pass, only 4 is accepted.",
+            false, 1, "1|4|8", cmd);
+  TCLAP::ValueArg<size_t> mem_budget_arg("b", "mem_budget",
+            "Memory budget (in MB) for the kmer tables. If they don't fit, sorted runs are written to temporary files "
+            "([output_prefix]" + extension + ".run.*) and merged. Not with --mmap or --low_mem. Default: no limit.",
+            false, 0, "megabytes", cmd);
+  TCLAP::SwitchArg low_mem_arg("l", "low_mem",
+            "Sort the kmers in place and derive the second (colex row ordered) table from the first, "
+            "which halves the memory needed.", cmd, false);
+  TCLAP::ValueArg<uint32_t> kmer_size_arg("k", "kmer_size",
+            "Count the kmers of this length (up to 128) in the reads of the input file, instead of reading them "
+            "from a DSK file.", false, 0, "length", cmd);
+  TCLAP::ValueArg<size_t> min_count_arg("c", "min_count",
+            "With --kmer_size, only keep the kmers seen at least this many times (e.g. 2 or 3 to drop most of "
+            "the kmers with sequencing errors). Default: 1.", false, 1, "count", cmd);
+  TCLAP::SwitchArg generic_k_arg("g", "generic_k",
+            "Use the generic version of the kmer functions even if there is one compiled for this k "
+            "(21, 25, 27, 31, 41, 55 and 63). Only useful to compare them.", cmd, false);
   cmd.parse( argc, argv );
   //params.ascii         = ascii_arg.getValue();
+  params.use_mmap        = mmap_arg.getValue();
+  params.num_threads     = std::max((size_t)1, threads_arg.getValue());
+  params.nts_per_pass    = nts_per_pass_arg.getValue();
+  if (params.nts_per_pass != 1 && params.nts_per_pass != 4 && params.nts_per_pass != 8) {
+    fprintf(stderr, "ERROR: --nts_per_pass must be 1, 4 or 8.\n");
+    exit(EXIT_FAILURE);
+  }
+  params.mem_budget      = mem_budget_arg.getValue() << 20;
+  params.low_mem         = low_mem_arg.getValue();
+  params.kmer_size       = kmer_size_arg.getValue();
+  params.min_count       = std::max((size_t)1, min_count_arg.getValue());
+  if (params.kmer_size > MAX_BITS_PER_KMER / NT_WIDTH) {
+    fprintf(stderr, "ERROR: --kmer_size must be at most %zu.\n", MAX_BITS_PER_KMER / NT_WIDTH);
+    exit(EXIT_FAILURE);
+  }
+  if (params.kmer_size > 0 && params.mem_budget > 0) {
+    fprintf(stderr, "ERROR: --mem_budget only applies to DSK input (not with --kmer_size).\n");
+    exit(EXIT_FAILURE);
+  }
+  check_low_mem_nts_per_pass(params.low_mem, params.nts_per_pass);
+  // The external sort reads the file in chunks and spills both tables of each, so it can't use either
+  if (params.mem_budget > 0 && (params.use_mmap || params.low_mem)) {
+    fprintf(stderr, "ERROR: --mem_budget can't be combined with --mmap or --low_mem.\n");
+    exit(EXIT_FAILURE);
+  }
+  params.generic_k       = generic_k_arg.getValue();
   params.input_filename  = input_filename_arg.getValue();
   params.output_prefix   = output_prefix_arg.getValue();
 }
 
+// Converts the kmers (or the DSK file, if sorting externally) as kmer_t kmers, writing the edges to out.
+// Returns whether k was one convert_static_k compiled for.
+struct kmer_packer {
+  PackedEdgeOutputer & out;
+  #ifdef VAR_ORDER
+  ofstream & lcs;
+  #endif
+  const parameters_t & params;
+  int      handle;
+  uint32_t kmer_num_bits;
+  size_t   num_kmers;
+  uint32_t k;
+  bool     external;
+  string   run_prefix;
+
+  template <typename kmer_t>
+  bool operator()(kmer_t * kmers) {
+    auto visitor = [&](edge_tag tag, const kmer_t & x, const uint32_t this_k, size_t lcs_len, bool first_end_node) {
+      #ifdef VAR_ORDER
+      out.write(tag, x, this_k, (lcs_len != k-1), first_end_node);
+      char l(lcs_len);
+      lcs.write((char*)&l, 1);
+      #else
+      out.write(tag, x, this_k, lcs_len, first_end_node);
+      #endif
+    };
+    if (external) convert_external<kmer_t>(handle, kmer_num_bits, num_kmers, k, params.mem_budget, run_prefix, visitor,
+                                           params.num_threads, params.nts_per_pass);
+    else if (!params.generic_k) return convert_static_k(kmers, num_kmers, k, visitor, params.num_threads,
+                                                        params.nts_per_pass, params.low_mem);
+    else if (params.low_mem) convert_low_mem(kmers, num_kmers, k, visitor, params.num_threads);
+    else convert(kmers, num_kmers, k, visitor, params.num_threads, params.nts_per_pass);
+    return false;
+  }
+};
+
 int main(int argc, char * argv[]) {
   parameters_t params;
   parse_arguments(argc, argv, params);
 
   const char * file_name = params.input_filename.c_str();
 
-  // Open File
+  // Open File, Read Header and how many items there are (for allocation purposes)
+  uint32_t kmer_num_bits = 0;
+  uint32_t k = 0;
+  size_t num_kmers = 0;
   int handle = -1;
-  if ( (handle = open(file_name, O_RDONLY)) == -1 ) {
-    fprintf(stderr, "ERROR: Can't open file: %s\n", file_name);
-    exit(EXIT_FAILURE);
-  }
+  if (params.kmer_size == 0) handle = dsk_open(file_name, &kmer_num_bits, &k, &num_kmers);
+  uint32_t kmer_num_blocks = (kmer_num_bits / 8) / sizeof(uint64_t);
+  TRACE("kmer_num_blocks = %d\n", kmer_num_blocks);
 
   // The parameter should be const... On my computer the parameter
   // isn't const though, yet it doesn't modify the string...
   // This is still done AFTER loading the file just in case
   char * base_name = basename(const_cast<char*>(file_name));
 
-  // Read Header
-  uint32_t kmer_num_bits = 0;
-  uint32_t k = 0;
-  if ( !dsk_read_header(handle, &kmer_num_bits, &k) ) {
-    fprintf(stderr, "ERROR: Error reading file %s\n", file_name);
-    exit(EXIT_FAILURE);
-  }
-  uint32_t kmer_num_blocks = (kmer_num_bits / 8) / sizeof(uint64_t);
-  TRACE(">> READING DSK FILE\n");
-  TRACE("kmer_num_bits, k = %d, %d\n", kmer_num_bits, k);
-  TRACE("kmer_num_blocks = %d\n", kmer_num_blocks);
-
-  if (kmer_num_bits > MAX_BITS_PER_KMER) {
-    fprintf(stderr, "ERROR: Kmers larger than %zu bits are not currently supported."
-                    " %s uses %d bits per kmer (possibly corrupt?).\n",
-            MAX_BITS_PER_KMER, file_name, kmer_num_bits);
-    exit(EXIT_FAILURE);
-  }
-
-  // Read how many items there are (for allocation purposes)
-  size_t num_kmers = 0;
-  if ( dsk_num_records(handle, kmer_num_bits, &num_kmers) == -1) {
-    fprintf(stderr, "Error seeking file %s\n", file_name);
-    exit(EXIT_FAILURE);
-  }
-  if (num_kmers == 0) {
-    fprintf(stderr, "ERROR: File %s has no kmers (possibly corrupt?).\n", file_name);
-    exit(EXIT_FAILURE);
-  }
-  TRACE("num_kmers = %zu\n", num_kmers);
-
   // ALLOCATE SPACE FOR KMERS (done in one malloc call)
   // x 4 because we need to add reverse complements, and then we have two copies of the table
+  // (unless in low memory mode, where we only have one)
   #ifdef ADD_REVCOMPS
   size_t revcomp_factor = 2;
   #else
   size_t revcomp_factor = 1;
   #endif
-  uint64_t * kmer_blocks = (uint64_t*)malloc(num_kmers * 2 * revcomp_factor * sizeof(uint64_t) * kmer_num_blocks);
-  if (!kmer_blocks) {
-    cerr << "Error allocating space for kmers" << endl;
-    exit(1);
+  size_t table_factor = (params.low_mem)? 1 : 2;
+  size_t table_bytes = num_kmers * table_factor * revcomp_factor * sizeof(uint64_t) * kmer_num_blocks;
+  // If the tables don't fit in the memory budget, they are sorted in runs and merged from disk (in convert_external).
+  // With a budget there are always two tables (--low_mem is rejected), as convert_external allocates.
+  bool external = params.mem_budget > 0 && table_bytes > params.mem_budget;
+  uint64_t * kmer_blocks = 0;
+  if (params.kmer_size > 0) {
+    k = params.kmer_size;
+    kmer_blocks = count_read_kmers(file_name, k, params.min_count, table_factor * revcomp_factor, params.num_threads,
+                                   &kmer_num_bits, &num_kmers);
   }
-
-
-  // READ KMERS FROM DISK INTO ARRAY
-  size_t num_records_read = dsk_read_kmers(handle, kmer_num_bits, kmer_blocks);
-  close(handle);
-  if (num_records_read == 0) {
-    fprintf(stderr, "Error reading file %s\n", argv[1]);
-    exit(EXIT_FAILURE);
+  else if (!external) {
+    kmer_blocks = dsk_read_all_kmers(handle, file_name, kmer_num_bits, num_kmers, table_bytes,
+                                     params.use_mmap, params.num_threads);
+  }
+  else {
+    fprintf(stderr, "Tables need %zu MB (budget %zu MB), sorting externally\n", table_bytes >> 20, params.mem_budget >> 20);
   }
-  TRACE("num_records_read = %zu\n", num_records_read);
-  assert (num_records_read == num_kmers);
 
   //auto ascii_output = std::ostream_iterator<string>(std::cout, "\n");
 
@@ -265,38 +234,19 @@ int main(int argc, char * argv[]) {
   lcs.open(outfilename + extension + ".lcs", ios::out | ios::binary);
   #endif
   PackedEdgeOutputer out(ofs);
+  string run_prefix = outfilename + extension + ".run";
+  auto convert_start = chrono::high_resolution_clock::now();
 
-  if (kmer_num_bits == 64) {
-    typedef uint64_t kmer_t;
-    size_t prev_k = 0; // for input, k is always >= 1
-      convert(kmer_blocks, num_kmers, k,
-        [&](edge_tag tag, const kmer_t & x, const uint32_t this_k, size_t lcs_len, bool first_end_node) {
-          #ifdef VAR_ORDER
-          out.write(tag, x, this_k, (lcs_len != k-1), first_end_node);
-          char l(lcs_len);
-          lcs.write((char*)&l, 1);
-          #else
-          out.write(tag, x, this_k, lcs_len, first_end_node);
-          #endif
-          prev_k = this_k;
-        });
-  }
-  else if (kmer_num_bits == 128) {
-    typedef uint128_t kmer_t;
-    size_t prev_k = 0;
-    kmer_t * kmer_blocks_128 = (kmer_t*)kmer_blocks;
-    convert(kmer_blocks_128, num_kmers, k,
-        [&](edge_tag tag, const kmer_t & x, const uint32_t this_k, size_t lcs_len, bool first_end_node) {
-          #ifdef VAR_ORDER
-          out.write(tag, x, this_k, (lcs_len != k-1), first_end_node);
-          char l(lcs_len);
-          lcs.write((char*)&l, 1);
-          #else
-          out.write(tag, x, this_k, lcs_len, first_end_node);
-          #endif
-          prev_k = this_k;
-        });
-  }
+  kmer_packer pack{out,
+                   #ifdef VAR_ORDER
+                   lcs,
+                   #endif
+                   params, handle, kmer_num_bits, num_kmers, k, external, run_prefix};
+  bool used_static_k = with_kmer_type(kmer_blocks, kmer_num_bits, pack);
+  if (external) close(handle);
+  double convert_secs = chrono::duration<double>(chrono::high_resolution_clock::now() - convert_start).count();
+  fprintf(stderr, "Packed in %.3f s (k = %u, %s)\n", convert_secs, k,
+          (used_static_k)? "compiled for this k" : "generic k");
 
   out.close();
   #ifdef VAR_ORDER
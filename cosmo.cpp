@@ -0,0 +1,258 @@
+// Runs cosmo-pack and cosmo-build as one pipeline: the merged edges are written straight into the vectors
+// the graph is built from, instead of being written to a .packed file and read back.
+#include <iostream>
+#include <chrono>
+#include <thread>
+
+#include <libgen.h> // basename
+
+#include "tclap/CmdLine.h"
+
+#include <sdsl/bit_vectors.hpp>
+#include <sdsl/wavelet_trees.hpp>
+
+#define BOOST_RESULT_OF_USE_DECLTYPE // needed to support lambdas in transformed
+
+#include "uint128_t.hpp"
+#include "kmer.hpp"
+#include "io.hpp"
+#include "pack.hpp"
+#include "reads.hpp"
+#include "debruijn_graph.hpp"
+#include "lcs_vector.hpp"
+#include "debug.h"
+
+using namespace std;
+using namespace sdsl;
+
+const static string extension = ".dbg";
+
+struct parameters_t {
+  bool use_mmap = false;
+  size_t num_threads = 1;
+  size_t nts_per_pass = 1;
+  size_t mem_budget = 0; // bytes, 0 -> no limit
+  bool low_mem = false;
+  vector<size_t> lcs_levels;
+  size_t lcs_threshold = 0;
+  uint32_t kmer_size = 0; // 0 -> the input is a DSK file
+  size_t min_count = 1;
+  std::string input_filename = "";
+  std::string output_prefix = "";
+};
+
+void parse_arguments(int argc, char **argv, parameters_t & params);
+void parse_arguments(int argc, char **argv, parameters_t & params)
+{
+  TCLAP::CmdLine cmd("Cosmo Copyright (c) Alex Bowe (alexbowe.com) 2014", ' ', VERSION);
+  TCLAP::UnlabeledValueArg<std::string> input_filename_arg("input",
+            "Input file: DSK's binary format (for k<=128), or FASTA/FASTQ reads (optionally gzipped) with --kmer_size.",
+            true, "", "input_file", cmd);
+  string output_short_form = "output_prefix";
+  TCLAP::ValueArg<std::string> output_prefix_arg("o", "output_prefix",
+            "Output prefix. Graph will be written to [" + output_short_form + "]" + extension + ". " +
+            "Default prefix: basename(input_file).", false, "", output_short_form, cmd);
+  TCLAP::SwitchArg mmap_arg("m", "mmap",
+            "Memory map the input file and extract kmers in parallel (faster for large files).", cmd, false);
+  size_t default_threads = std::max(1u, thread::hardware_concurrency());
+  TCLAP::ValueArg<size_t> threads_arg("t", "threads",
+            "Number of threads used to read and sort the kmers. Default: number of cores (" + to_string(default_threads) + ").",
+            false, default_threads, "num_threads", cmd);
+  TCLAP::ValueArg<size_t> nts_per_pass_arg("w", "nts_per_pass",
+            "Number of nucleotides to sort per radix pass (1, 4 or 8). Wider passes make fewer passes over memory. "
+            "With --low_mem, whose in place sort always takes 4 nucleotides per pass, only 4 is accepted.",
+            false, 1, "1|4|8", cmd);
+  TCLAP::ValueArg<size_t> mem_budget_arg("b", "mem_budget",
+            "Memory budget (in MB) for the kmer tables. If they don't fit, sorted runs are written to temporary files "
+            "([output_prefix]" + extension + ".run.*) and merged. Not with --mmap or --low_mem. Default: no limit.",
+            false, 0, "megabytes", cmd);
+  TCLAP::SwitchArg low_mem_arg("l", "low_mem",
+            "Sort the kmers in place and derive the second (colex row ordered) table from the first, "
+            "which halves the memory needed.", cmd, false);
+  TCLAP::ValueArg<uint32_t> kmer_size_arg("k", "kmer_size",
+            "Count the kmers of this length (up to 128) in the reads of the input file, instead of reading them "
+            "from a DSK file.", false, 0, "length", cmd);
+  TCLAP::ValueArg<size_t> min_count_arg("c", "min_count",
+            "With --kmer_size, only keep the kmers seen at least this many times (e.g. 2 or 3 to drop most of "
+            "the kmers with sequencing errors). Default: 1.", false, 1, "count", cmd);
+  #ifdef VAR_ORDER
+  TCLAP::MultiArg<size_t> lcs_levels_arg("q", "lcs_level",
+            "Quantize the LCS values: each one becomes the largest of these levels that is <= it (or 0). Repeat the "
+            "option for each level. Default: keep the values as they are.", false, "level", cmd);
+  TCLAP::ValueArg<size_t> lcs_threshold_arg("", "lcs_threshold",
+            "Set the LCS values below this one to 0 (instead of --lcs_level).", false, 0, "threshold", cmd);
+  #endif
+  cmd.parse( argc, argv );
+  params.use_mmap        = mmap_arg.getValue();
+  params.num_threads     = std::max((size_t)1, threads_arg.getValue());
+  params.nts_per_pass    = nts_per_pass_arg.getValue();
+  if (params.nts_per_pass != 1 && params.nts_per_pass != 4 && params.nts_per_pass != 8) {
+    fprintf(stderr, "ERROR: --nts_per_pass must be 1, 4 or 8.\n");
+    exit(EXIT_FAILURE);
+  }
+  params.mem_budget      = mem_budget_arg.getValue() << 20;
+  params.low_mem         = low_mem_arg.getValue();
+  params.kmer_size       = kmer_size_arg.getValue();
+  params.min_count       = std::max((size_t)1, min_count_arg.getValue());
+  if (params.kmer_size > MAX_BITS_PER_KMER / NT_WIDTH) {
+    fprintf(stderr, "ERROR: --kmer_size must be at most %zu.\n", MAX_BITS_PER_KMER / NT_WIDTH);
+    exit(EXIT_FAILURE);
+  }
+  if (params.kmer_size > 0 && params.mem_budget > 0) {
+    fprintf(stderr, "ERROR: --mem_budget only applies to DSK input (not with --kmer_size).\n");
+    exit(EXIT_FAILURE);
+  }
+  check_low_mem_nts_per_pass(params.low_mem, params.nts_per_pass);
+  // The external sort reads the file in chunks and spills both tables of each, so it can't use either
+  if (params.mem_budget > 0 && (params.use_mmap || params.low_mem)) {
+    fprintf(stderr, "ERROR: --mem_budget can't be combined with --mmap or --low_mem.\n");
+    exit(EXIT_FAILURE);
+  }
+  #ifdef VAR_ORDER
+  params.lcs_levels      = lcs_levels_arg.getValue();
+  params.lcs_threshold   = lcs_threshold_arg.getValue();
+  if (!params.lcs_levels.empty() && params.lcs_threshold > 0) {
+    fprintf(stderr, "ERROR: --lcs_level and --lcs_threshold can't be used together.\n");
+    exit(EXIT_FAILURE);
+  }
+  #endif
+  params.input_filename  = input_filename_arg.getValue();
+  params.output_prefix   = output_prefix_arg.getValue();
+}
+
+// Converts the kmers (or the DSK file, if sorting externally) as kmer_t kmers, writing the edges to out
+struct kmer_packer {
+  graph_edge_builder & out;
+  #ifdef VAR_ORDER
+  int_vector<> & lcs;
+  size_t & num_lcs;
+  const lcs_quantizer & quantize;
+  #endif
+  const parameters_t & params;
+  int      handle;
+  uint32_t kmer_num_bits;
+  size_t   num_kmers;
+  uint32_t k;
+  bool     external;
+  string   run_prefix;
+
+  template <typename kmer_t>
+  void operator()(kmer_t * kmers) {
+    auto visitor = [&](edge_tag tag, const kmer_t & x, const uint32_t this_k, size_t lcs_len, bool first_end_node) {
+      #ifdef VAR_ORDER
+      out.write(tag, x, this_k, (lcs_len != k-1), first_end_node);
+      if (num_lcs == lcs.size()) lcs.resize(num_lcs + num_lcs/4 + 1024);
+      lcs[num_lcs++] = quantize(lcs_len);
+      #else
+      out.write(tag, x, this_k, lcs_len, first_end_node);
+      #endif
+    };
+    if (external) convert_external<kmer_t>(handle, kmer_num_bits, num_kmers, k, params.mem_budget, run_prefix, visitor,
+                                           params.num_threads, params.nts_per_pass);
+    else convert_static_k(kmers, num_kmers, k, visitor, params.num_threads, params.nts_per_pass, params.low_mem);
+  }
+};
+
+// Prints the time since the last call (or since construction) and the peak RSS so far
+class stage_reporter {
+  chrono::high_resolution_clock::time_point _last = chrono::high_resolution_clock::now();
+
+  public:
+  void operator()(const char * stage) {
+    auto now = chrono::high_resolution_clock::now();
+    fprintf(stderr, "%-8s: %.3f s (peak RSS %.1f MB)\n", stage,
+            chrono::duration<double>(now - _last).count(), peak_rss_mb());
+    _last = now;
+  }
+};
+
+int main(int argc, char * argv[]) {
+  parameters_t params;
+  parse_arguments(argc, argv, params);
+  stage_reporter report;
+
+  const char * file_name = params.input_filename.c_str();
+  uint32_t kmer_num_bits = 0;
+  uint32_t k = 0;
+  size_t num_kmers = 0;
+  int handle = -1;
+  if (params.kmer_size == 0) handle = dsk_open(file_name, &kmer_num_bits, &k, &num_kmers);
+  uint32_t kmer_num_blocks = (kmer_num_bits / 8) / sizeof(uint64_t);
+  char * base_name = basename(const_cast<char*>(file_name));
+  string outfilename = ((params.output_prefix == "")? base_name : params.output_prefix) + extension;
+
+  #ifdef ADD_REVCOMPS
+  size_t revcomp_factor = 2;
+  #else
+  size_t revcomp_factor = 1;
+  #endif
+  size_t table_factor = (params.low_mem)? 1 : 2;
+  size_t table_bytes = num_kmers * table_factor * revcomp_factor * sizeof(uint64_t) * kmer_num_blocks;
+  // If the tables don't fit in the memory budget, they are sorted in runs and merged from disk (in convert_external).
+  // With a budget there are always two tables (--low_mem is rejected), as convert_external allocates.
+  bool external = params.mem_budget > 0 && table_bytes > params.mem_budget;
+  uint64_t * kmer_blocks = 0;
+  if (params.kmer_size > 0) {
+    k = params.kmer_size;
+    kmer_blocks = count_read_kmers(file_name, k, params.min_count, table_factor * revcomp_factor, params.num_threads,
+                                   &kmer_num_bits, &num_kmers);
+    report("count");
+  }
+  else if (!external) {
+    kmer_blocks = dsk_read_all_kmers(handle, file_name, kmer_num_bits, num_kmers, table_bytes,
+                                     params.use_mmap, params.num_threads);
+    report("read");
+  }
+  else {
+    fprintf(stderr, "Tables need %zu MB (budget %zu MB), sorting externally\n", table_bytes >> 20, params.mem_budget >> 20);
+  }
+
+  // The edge symbols are spilled to a temporary file, so only the node flags are held in memory until the graph is built
+  graph_edge_builder out(outfilename + ".edges.tmp", num_kmers * revcomp_factor);
+  #ifdef VAR_ORDER
+  // The LCS values are quantized as they are produced, and only take the bits the quantized values need
+  lcs_quantizer quantize(params.lcs_levels, params.lcs_threshold);
+  int_vector<> lcs(num_kmers * revcomp_factor, 0, quantize.width(k));
+  size_t num_lcs = 0;
+  #endif
+  string run_prefix = outfilename + ".run";
+
+  kmer_packer pack{out,
+                   #ifdef VAR_ORDER
+                   lcs, num_lcs, quantize,
+                   #endif
+                   params, handle, kmer_num_bits, num_kmers, k, external, run_prefix};
+  with_kmer_type(kmer_blocks, kmer_num_bits, pack);
+  if (external) close(handle);
+  free(kmer_blocks);
+  out.close();
+  report("pack");
+
+  debruijn_graph<> dbg = debruijn_graph<>::load_from_edges_file(k, out.first(), out.edges_filename(), out.counts(), "$ACGT");
+  out.clear();
+  report("build");
+
+  cerr << "k             : " << dbg.k << endl;
+  cerr << "num_nodes()   : " << dbg.num_nodes() << endl;
+  cerr << "num_edges()   : " << dbg.num_edges() << endl;
+  cerr << "Total size    : " << size_in_mega_bytes(dbg) << " MB" << endl;
+  cerr << "Bits per edge : " << bits_per_element(dbg) << " Bits" << endl;
+
+  store_to_file(dbg, outfilename);
+
+  #ifdef VAR_ORDER
+  lcs.resize(num_lcs);
+  wt_int<rrr_vector<63>> lcs_wt;
+  construct_im(lcs_wt, lcs);
+  rmq_lcs_vector lcs_rmq(lcs);
+  int_vector<>().swap(lcs);
+  cerr << "LCS size      : " << size_in_mega_bytes(lcs_wt) << " MB" << endl;
+  cerr << "LCS bits/edge : " << bits_per_element(lcs_wt) << " Bits" << endl;
+  store_to_file(lcs_wt, outfilename + ".lcs.wt");
+  cerr << "LCS RMQ size  : " << size_in_mega_bytes(lcs_rmq) << " MB" << endl;
+  cerr << "LCS RMQ b/edge: " << bits_per_element(lcs_rmq) << " Bits" << endl;
+  store_to_file(lcs_rmq, outfilename + ".lcs.rmq");
+  #endif
+  report("store");
+  return 0;
+}
@@ -8,6 +8,7 @@
 #include <array>
 #include <string>
 #include <iostream>
+#include <stdexcept>
 
 #include <sdsl/bit_vectors.hpp>
 #include <sdsl/wavelet_trees.hpp>
@@ -75,7 +76,11 @@ class debruijn_graph {
   }
 
   public:
-  static debruijn_graph load_from_packed_edges(istream & input, label_type alphabet=label_type{}, vector<size_t> * v=nullptr) {
+  // Reads the .packed file a window of blocks at a time. If temp_filename is given, the edge symbols are streamed
+  // to it (one byte each) and the wavelet tree is constructed from the file, so only the node flags are held in
+  // memory (1 bit per edge) on top of the graph itself. The temporary file is removed afterwards.
+  static debruijn_graph load_from_packed_edges(istream & input, label_type alphabet=label_type{}, vector<size_t> * v=nullptr,
+                                               const string & temp_filename="") {
     // ifstream input(filename, ios::in|ios::binary|ios::ate);
     // check length
     streampos size = input.tellg();
@@ -94,36 +99,79 @@ class debruijn_graph {
     size_t num_blocks = size_t(size)/sizeof(uint64_t) - (sigma+2);
     input.seekg(0, ios::beg); // rewind
 
-    // TODO: Loop through this while reading from file instead (to avoid memory waste)
-    vector<uint64_t> blocks(num_blocks,0);
-    input.read((char*)&blocks[0], sizeof(uint64_t) * num_blocks);
-
     // TODO: sanity check the inputs (e.g. tally things, convert the above asserts)
     // So we avoid a huge malloc if someone gives us a bad file
     int_vector<1> first(num_edges,0);
     // would be nice to fix wavelet trees so the constructor
     // can accept a int_vector<4> instead (which is all we need for DNA)
-    int_vector<8> edges(num_edges);
-
-    bool prev_was_minus = false;
-    for (size_t i = 0; i < num_edges; i++) {
-      auto x = get_edge(blocks.begin(), i);
-      first[i] = 1-get<1>(x); // convert 0s to 1s so we can have a sparse bit vector
-      // For branchy graphs it might be better to change this and use RRR
-      edges[i] = (get<0>(x) << 1) | !get<2>(x);
-      if (v && get<0>(x) && !get<2>(x) && !prev_was_minus) {
-        v->push_back(i);
-        prev_was_minus = true;
+    bool stream_edges = (temp_filename != "");
+    int_vector<8> edges((stream_edges)? 0 : num_edges);
+    ofstream edges_file;
+    if (stream_edges) edges_file.open(temp_filename, ios::out | ios::binary);
+
+    const size_t window_blocks = 1 << 16;
+    vector<uint64_t> blocks(std::min(num_blocks, window_blocks), 0);
+    vector<uint8_t>  symbols((stream_edges)? blocks.size() * PACKED_CAPACITY : 0);
+    // the first minus flag in each run of minus flags of a symbol (the rest go to the same node)
+    array<bool, 1+sigma> prev_was_minus{};
+    for (size_t block_start = 0; block_start < num_blocks; block_start += blocks.size()) {
+      size_t window = std::min(blocks.size(), num_blocks - block_start);
+      input.read((char*)&blocks[0], sizeof(uint64_t) * window);
+      size_t edge_start = block_start * PACKED_CAPACITY;
+      size_t edge_end   = std::min(num_edges, (block_start + window) * PACKED_CAPACITY);
+      for (size_t i = edge_start; i < edge_end; i++) {
+        auto x = get_edge(blocks.begin(), i - edge_start);
+        first[i] = 1-get<1>(x); // convert 0s to 1s so we can have a sparse bit vector
+        // For branchy graphs it might be better to change this and use RRR
+        uint8_t symbol = (get<0>(x) << 1) | !get<2>(x);
+        if (stream_edges) symbols[i - edge_start] = symbol;
+        else edges[i] = symbol;
+        if (v && get<0>(x) && !get<2>(x) && !prev_was_minus[get<0>(x)]) {
+          v->push_back(i);
+          prev_was_minus[get<0>(x)] = true;
+        }
+        else if (v && get<0>(x) && get<2>(x)) prev_was_minus[get<0>(x)] = false;
       }
-      else if (v && get<0>(x) && get<2>(x)) prev_was_minus = false;
+      if (stream_edges) edges_file.write((char*)&symbols[0], edge_end - edge_start);
     }
+    vector<uint64_t>().swap(blocks);
+
+    if (!stream_edges) return load_from_edges(k, first, edges, counts, alphabet);
 
+    edges_file.close();
+    debruijn_graph g = load_from_edges_file(k, first, temp_filename, counts, alphabet);
+    remove(temp_filename.c_str());
+    return g;
+  }
+
+  // Builds the graph from vectors in the same form as load_from_packed_edges produces:
+  // first[i] is 0 if edge i is the first edge of its node, edges[i] is (W symbol << 1) | !(first incoming edge flag),
+  // and counts are the cumulative counts of the F symbols (as in the .packed footer). See graph_edge_builder.
+  static debruijn_graph load_from_edges(size_t k, const int_vector<1> & first, const int_vector<8> & edges,
+                                        const array<size_t, 1+sigma> & counts, label_type alphabet=label_type{}) {
     t_bit_vector_type bv(first);
     t_edge_vector_type wt;
     construct_im(wt, edges);
     return debruijn_graph(k, bv, wt, counts, alphabet);
   }
 
+  // Same as load_from_edges, but with the edge symbols in a file (one byte each, as load_from_packed_edges and
+  // graph_edge_builder write them), which the edge vector is constructed from. first is freed on the way.
+  static debruijn_graph load_from_edges_file(size_t k, int_vector<1> & first, const string & edges_filename,
+                                             const array<size_t, 1+sigma> & counts, label_type alphabet=label_type{}) {
+    t_bit_vector_type bv(first);
+    int_vector<1>().swap(first);
+    t_edge_vector_type wt;
+    construct(wt, edges_filename, 1);
+    return debruijn_graph(k, bv, wt, counts, alphabet);
+  }
+
+  // Builds a graph around already constructed components (e.g. memory mapped ones, see mapped_graph.hpp)
+  static debruijn_graph load_from_components(size_t k, const t_bit_vector_type & node_flags, const t_edge_vector_type & edges,
+                                             const array<size_t, 1+sigma> & symbol_ends, const label_type & alphabet) {
+    return debruijn_graph(k, node_flags, edges, symbol_ends, alphabet);
+  }
+
   // Loaders/Writers for sdsl-serialized and JSON
   // size_in_bytes:
 
@@ -187,16 +235,9 @@ class debruijn_graph {
     auto range = _node_range(u);
     size_t first = get<0>(range);
     size_t last  = get<1>(range);
-    // Try both with and without a flag
-    for (symbol_type c = _with_edge_flag(x,false); c <= _with_edge_flag(x, true); c++) {
-      size_t most_recent = m_edges.select(m_edges.rank(last+1, c), c);
-      // if within range, follow forward
-      if (first <= most_recent && most_recent <= last) {
-        // Don't have to check fwd for -1 since we checked for $ above
-        return _edge_to_node(_forward(most_recent));
-      }
-    }
-    return -1;
+    ssize_t edge = _last_edge_labelled(first, last, x);
+    // Don't have to check fwd for -1 since we checked for $ above
+    return (edge == -1)? -1 : (ssize_t)_edge_to_node(_forward(edge));
   }
 
   // Added for DCC. Will remove the other one later and rename this one.
@@ -207,34 +248,56 @@ class debruijn_graph {
     //auto range = _node_range(u);
     size_t first = get<0>(u);
     size_t last  = get<1>(u);
-    // Try both with and without a flag
-    for (symbol_type c = _with_edge_flag(x,false); c <= _with_edge_flag(x, true); c++) {
-      size_t most_recent = m_edges.select(m_edges.rank(last+1, c), c);
-      // if within range, follow forward
-      if (first <= most_recent && most_recent <= last) {
-        // Don't have to check fwd for -1 since we checked for $ above
-        return _edge_to_node(_forward(most_recent));
-      }
-    }
-    return -1;
+    ssize_t edge = _last_edge_labelled(first, last, x);
+    // Don't have to check fwd for -1 since we checked for $ above
+    return (edge == -1)? -1 : (ssize_t)_edge_to_node(_forward(edge));
   }
 
 
 
   // For DCC
   ssize_t _outgoing_edge_pair(size_t first, size_t last, symbol_type x) const {
-    // Try both with and without a flag
-    for (symbol_type c = _with_edge_flag(x,false); c <= _with_edge_flag(x, true); c++) {
-      size_t most_recent = m_edges.select(m_edges.rank(last+1, c), c);
-      // if within range, follow forward
-      if (first <= most_recent && most_recent <= last) {
-        // Don't have to check fwd for -1 since we checked for $ above
-        return _forward(most_recent);
+    ssize_t edge = _last_edge_labelled(first, last, x);
+    return (edge == -1)? -1 : _forward(edge);
+  }
+
+  // Last edge in [first, last] labelled x, with or without the minus flag, or -1 if there isn't one (the "most
+  // recent occurrence" step of outgoing). Both flags are found in one pass if the edge vector has a prev_occurrence
+  // (interleaved_edge_vector, mapped_edge_vector). Otherwise short ranges are scanned (a node has at most sigma+1
+  // edges), and only longer ones take a rank and select per flag.
+  ssize_t _last_edge_labelled(size_t first, size_t last, symbol_type x) const {
+    return _last_edge_labelled(first, last, x, m_edges, 0);
+  }
+
+  private:
+  template <class t_edges>
+  auto _last_edge_labelled(size_t first, size_t last, symbol_type x, const t_edges & edges, int) const
+      -> decltype(edges.prev_occurrence(last, x, x, first), ssize_t()) {
+    size_t edge = edges.prev_occurrence(last, _with_edge_flag(x, false), _with_edge_flag(x, true), first);
+    return (edge == edges.size())? -1 : (ssize_t)edge;
+  }
+
+  template <class t_edges>
+  ssize_t _last_edge_labelled(size_t first, size_t last, symbol_type x, const t_edges & edges, long) const {
+    if (last - first <= sigma) {
+      for (size_t i = last + 1; i-- > first;) {
+        if (_strip_edge_flag(edges[i]) == x) return i;
       }
+      return -1;
+    }
+    ssize_t result = -1;
+    for (bool flag : {false, true}) {
+      symbol_type c = _with_edge_flag(x, flag);
+      size_t count = edges.rank(last+1, c);
+      if (count == 0) continue;
+      ssize_t most_recent = edges.select(count, c);
+      if ((ssize_t)first <= most_recent && most_recent > result) result = most_recent;
     }
-    return -1;
+    return result;
   }
 
+  public:
+
   // incoming
   ssize_t incoming(size_t v, symbol_type x) const {
     // This is very similar to indegree, so should maybe be refactored
@@ -260,6 +323,126 @@ class debruijn_graph {
   }
 
   // string -> node, edge
+  // Labels are extended one symbol at a time from the right, starting from the F range of their first symbol (the
+  // nodes whose labels end with it): following the edges labelled with the next symbol out of the current range gives
+  // the range of nodes whose labels end with the prefix read so far. Leading $s start from the all-$ node instead.
+
+  // The node labelled label (k-1 symbols), or -1 if there isn't one
+  ssize_t find_node(const label_type & label) const {
+    size_t pos = 0;
+    node_type range = _label_start(label, pos);
+    return _find_node_from(label, range, pos);
+  }
+
+  // The edge labelled label (k symbols), or -1 if there isn't one
+  ssize_t find_edge(const label_type & label) const {
+    if (label.size() != k) return -1;
+    ssize_t v = find_node(label.substr(0, k-1));
+    symbol_type x = _unmap_symbol(label[k-1]);
+    if (v == -1 || x > sigma) return -1;
+    auto range = _node_range(v);
+    return _last_edge_labelled(get<0>(range), get<1>(range), x);
+  }
+
+  // find_node for n labels, stepping through a group of them at a time so their cache misses overlap
+  // (see forward_batch)
+  void find_nodes(const label_type * labels, size_t n, ssize_t * out) const {
+    vector<node_type> starts(std::min(n, (size_t)batch_group));
+    vector<size_t> from(starts.size());
+    for (size_t base = 0; base < n; base += batch_group) {
+      size_t g = std::min((size_t)batch_group, n - base);
+      for (size_t q = 0; q < g; q++) starts[q] = _label_start(labels[base+q], from[q]);
+      _find_nodes_from(labels + base, g, &starts[0], &from[0], out + base);
+    }
+  }
+
+  // Range of the nodes whose labels end with the first pos symbols of label, where pos is set to the number of
+  // symbols it could start with (1, or all the leading $s). Empty (first > last) if the label can't start here.
+  node_type _label_start(const label_type & label, size_t & pos) const {
+    pos = 0;
+    while (pos < label.size() && pos < k-1 && _unmap_symbol(label[pos]) == 0) pos++;
+    if (pos > 0) return get_node(0); // the all-$ node
+    if (label.empty()) return node_type(1, 0);
+    symbol_type x = _unmap_symbol(label[0]);
+    if (x > sigma || _symbol_start(x) == m_symbol_ends[x]) return node_type(1, 0);
+    pos = 1;
+    return node_type(_symbol_start(x), m_symbol_ends[x] - 1);
+  }
+
+  // Range of the nodes whose labels end with those of range's nodes followed by x (empty if there are none)
+  node_type _extend_range(const node_type & range, symbol_type x) const {
+    if (x == 0 || x > sigma || get<0>(range) > get<1>(range)) return node_type(1, 0);
+    ssize_t last = _last_edge_labelled(get<0>(range), get<1>(range), x);
+    if (last == -1) return node_type(1, 0);
+    size_t first = _first_edge_labelled(get<0>(range), last, x);
+    size_t start = _forward(first);
+    size_t end_node = _edge_to_node((first == (size_t)last)? start : _forward(last));
+    return node_type(start, _last_edge_of_node(end_node));
+  }
+
+  // find_node for labels whose first from[q] symbols have already been matched to starts[q] (e.g. by a kmer_index)
+  void _find_nodes_from(const label_type * labels, size_t n, const node_type * starts, const size_t * from,
+                        ssize_t * out) const {
+    for (size_t base = 0; base < n; base += batch_group) {
+      size_t g = std::min((size_t)batch_group, n - base);
+      node_type range[batch_group];
+      size_t pos[batch_group];
+      size_t active = 0;
+      for (size_t q = 0; q < g; q++) {
+        range[q] = starts[base+q];
+        pos[q]   = from[base+q];
+        out[base+q] = -1;
+        if (labels[base+q].size() != k-1 || get<0>(range[q]) > get<1>(range[q])) pos[q] = k-1;
+        else if (pos[q] >= k-1) out[base+q] = _edge_to_node(get<0>(range[q]));
+        else active++;
+      }
+      // one symbol of every unfinished label per pass
+      while (active > 0) {
+        for (size_t q = 0; q < g; q++) if (pos[q] < k-1) PREFETCH(m_edges, get<1>(range[q]));
+        for (size_t q = 0; q < g; q++) {
+          if (pos[q] >= k-1) continue;
+          range[q] = _extend_range(range[q], _unmap_symbol(labels[base+q][pos[q]]));
+          if (get<0>(range[q]) > get<1>(range[q])) pos[q] = k-1;
+          else if (++pos[q] == k-1) out[base+q] = _edge_to_node(get<0>(range[q]));
+          if (pos[q] == k-1) active--;
+        }
+      }
+    }
+  }
+
+  ssize_t _find_node_from(const label_type & label, node_type range, size_t pos) const {
+    if (label.size() != k-1) return -1;
+    for (; pos < k-1 && get<0>(range) <= get<1>(range); pos++) range = _extend_range(range, _unmap_symbol(label[pos]));
+    if (get<0>(range) > get<1>(range)) return -1;
+    return _edge_to_node(get<0>(range));
+  }
+
+  // First edge in [first, last] labelled x, with or without the minus flag, or -1 if there isn't one
+  ssize_t _first_edge_labelled(size_t first, size_t last, symbol_type x) const {
+    if (last - first <= sigma) {
+      for (size_t i = first; i <= last; i++) {
+        if (_strip_edge_flag(m_edges[i]) == x) return i;
+      }
+      return -1;
+    }
+    ssize_t result = -1;
+    for (bool flag : {false, true}) {
+      symbol_type c = _with_edge_flag(x, flag);
+      size_t before = m_edges.rank(first, c);
+      if (m_edges.rank(last+1, c) == before) continue;
+      ssize_t next = m_edges.select(before + 1, c);
+      if (result == -1 || next < result) result = next;
+    }
+    return result;
+  }
+
+  // Inverse of _map_symbol (sigma+1 if c isn't in the alphabet)
+  symbol_type _unmap_symbol(typename label_type::value_type c) const {
+    if (m_alphabet.size() == 0) return ((size_t)c <= sigma)? c : sigma+1;
+    size_t x = m_alphabet.find(c);
+    return (x == label_type::npos || x > sigma)? sigma+1 : x;
+  }
+
   // BGL style API
 
   label_type node_label(size_t v) const {
@@ -375,12 +558,14 @@ class debruijn_graph {
   // This is so we can reuse the symbol lookup - save an access during traversal :)
   ssize_t _forward(size_t i, symbol_type & x) const {
     assert(i < num_edges());
-    x = _strip_edge_flag(m_edges[i]);
+    symbol_type w = m_edges[i];
+    x = _strip_edge_flag(w);
     // if x == 0 ($) then we can't follow the edge
     // (should maybe make backward consistent with this, but using the edge 0 loop for node label generation).
     if (x == 0) return -1;
     size_t start = _symbol_start(x);
-    size_t nth   = m_edges.rank(i, _with_edge_flag(x, false));
+    // A flagged edge goes to the same node as the last unflagged one before it (which the rank counts)
+    size_t nth   = m_edges.rank(i, _with_edge_flag(x, false)) - (w != _with_edge_flag(x, false));
     size_t next  = m_node_select(m_node_rank(start+1) + nth);
     return next;
   }
@@ -403,6 +588,88 @@ class debruijn_graph {
     return _edge_to_node(_backward(_node_to_edge(v)));
   }
 
+  // Batched versions of _forward, _backward and interval_node_outgoing, for many independent queries.
+  // Each of these is a chain of dependent rank/selects, so the queries are processed in groups and each step is
+  // done for the whole group before moving on, which lets the cache misses of different queries overlap.
+  static const size_t batch_group = 16;
+
+  // out[q] = _forward(edges[q])
+  void forward_batch(const size_t * edges, size_t n, ssize_t * out) const {
+    auto first_ranks = _symbol_first_node_ranks();
+    symbol_type w[batch_group], x[batch_group];
+    size_t nth[batch_group];
+    for (size_t base = 0; base < n; base += batch_group) {
+      size_t g = std::min((size_t)batch_group, n - base);
+      const size_t * e = edges + base;
+      for (size_t q = 0; q < g; q++) PREFETCH(m_edges, e[q]);
+      for (size_t q = 0; q < g; q++) {
+        w[q] = m_edges[e[q]];
+        x[q] = _strip_edge_flag(w[q]);
+      }
+      for (size_t q = 0; q < g; q++) {
+        if (x[q] != 0) nth[q] = m_edges.rank(e[q], _with_edge_flag(x[q], false)) - (w[q] != _with_edge_flag(x[q], false));
+      }
+      for (size_t q = 0; q < g; q++) {
+        out[base+q] = (x[q] == 0)? -1 : (ssize_t)m_node_select(first_ranks[x[q]] + nth[q]);
+      }
+    }
+  }
+
+  // out[q] = _backward(edges[q])
+  void backward_batch(const size_t * edges, size_t n, size_t * out) const {
+    auto first_ranks = _symbol_first_node_ranks();
+    symbol_type x[batch_group];
+    size_t nth[batch_group];
+    for (size_t base = 0; base < n; base += batch_group) {
+      size_t g = std::min((size_t)batch_group, n - base);
+      const size_t * e = edges + base;
+      for (size_t q = 0; q < g; q++) PREFETCH(m_node_flags, e[q]+1);
+      for (size_t q = 0; q < g; q++) {
+        x[q] = _symbol_access(e[q]);
+        nth[q] = m_node_rank(e[q]+1) - first_ranks[x[q]];
+      }
+      for (size_t q = 0; q < g; q++) {
+        out[base+q] = (x[q] == 0)? 0 : m_edges.select(nth[q]+1, _with_edge_flag(x[q], false));
+      }
+    }
+  }
+
+  // out[q] = interval_node_outgoing(nodes[q], xs[q])
+  void outgoing_batch(const node_type * nodes, const symbol_type * xs, size_t n, ssize_t * out) const {
+    size_t edge[batch_group];
+    for (size_t base = 0; base < n; base += batch_group) {
+      size_t g = std::min((size_t)batch_group, n - base);
+      const node_type * u = nodes + base;
+      const symbol_type * x = xs + base;
+      for (size_t q = 0; q < g; q++) PREFETCH(m_edges, get<1>(u[q]));
+      size_t found = 0;
+      for (size_t q = 0; q < g; q++) {
+        ssize_t most_recent = (x[q] == 0)? -1 : _last_edge_labelled(get<0>(u[q]), get<1>(u[q]), x[q]);
+        out[base+q] = -1;
+        if (most_recent != -1) {
+          edge[found] = most_recent;
+          out[base+q] = found++;
+        }
+      }
+      // out holds an index into edge for the queries that have an outgoing edge
+      ssize_t next[batch_group];
+      forward_batch(edge, found, next);
+      for (size_t q = 0; q < found; q++) PREFETCH(m_node_flags, next[q]);
+      for (size_t q = 0; q < g; q++) {
+        if (out[base+q] != -1) out[base+q] = _edge_to_node(next[out[base+q]]);
+      }
+    }
+  }
+
+  private:
+  // m_node_rank(_symbol_start(x)+1) for each x, which _forward and _backward need for every query
+  array<size_t, 1+sigma> _symbol_first_node_ranks() const {
+    array<size_t, 1+sigma> ranks;
+    for (symbol_type x = 0; x < sigma+1; x++) ranks[x] = m_node_rank(std::min(_symbol_start(x)+1, num_edges()));
+    return ranks;
+  }
+
+  public:
   symbol_type _map_symbol(symbol_type x) const {
     return (m_alphabet.size() > 0)? m_alphabet[x] : x;
   }
@@ -478,6 +745,83 @@ class debruijn_graph {
   size_type size() const { return num_edges(); }
 };
 
+// Visitor for the cosmo-pack merge (same interface as PackedEdgeOutputer) that collects what
+// debruijn_graph::load_from_edges_file needs, so a graph can be built without a .packed file. Only the node flags
+// are kept in memory (1 bit per edge); the edge symbols go to edges_filename a buffer at a time, as in
+// load_from_packed_edges. The file is removed by clear() (or the destructor).
+class graph_edge_builder {
+  static const size_t buffer_size = 1 << 20;
+
+  int_vector<1>   _first;
+  string          _edges_filename;
+  ofstream        _edges_file;
+  vector<uint8_t> _buffer;
+  size_t _buffered = 0;
+  size_t _size = 0;
+  array<size_t, DNA_RADIX+1> _counts{};
+  bool closed = false;
+
+  void _grow() {
+    _first.resize(_size + _size/4 + 1024);
+  }
+
+  void _flush() {
+    _edges_file.write((const char*)_buffer.data(), _buffered);
+    _buffered = 0;
+  }
+
+  public:
+  // capacity is just an initial guess of the number of edges (e.g. the number of records, not counting dummies)
+  graph_edge_builder(const string & edges_filename, size_t capacity = 0)
+    : _first(capacity, 0), _edges_filename(edges_filename),
+      _edges_file(edges_filename, ios::out | ios::binary | ios::trunc), _buffer(buffer_size) {
+    if (!_edges_file) throw runtime_error("Can't open " + edges_filename);
+  }
+
+  graph_edge_builder(const graph_edge_builder &) = delete;
+  graph_edge_builder & operator=(const graph_edge_builder &) = delete;
+
+  ~graph_edge_builder() { clear(); }
+
+  template <typename kmer_t>
+  void write(edge_tag tag, const kmer_t & x, const uint32_t k, bool first_start_node, bool first_end_node) {
+    assert(!closed);
+    if (_size == _first.size()) _grow();
+    _counts[get_f(tag, x, k)]++;
+    _first[_size] = !first_start_node;
+    _buffer[_buffered++] = (get_w(tag, x) << 1) | !first_end_node;
+    if (_buffered == _buffer.size()) _flush();
+    _size++;
+  }
+
+  // Trims the node flags, finishes the edges file and accumulates the counts
+  void close() {
+    if (closed) return;
+    _first.resize(_size);
+    _flush();
+    vector<uint8_t>().swap(_buffer);
+    _edges_file.close();
+    if (!_edges_file) throw runtime_error("Error writing " + _edges_filename);
+    for (size_t i = 1; i < DNA_RADIX+1; i++) _counts[i] += _counts[i-1];
+    closed = true;
+  }
+
+  size_t size() const { return _size; }
+  // load_from_edges_file frees these
+  int_vector<1> & first() { return _first; }
+  const string & edges_filename() const { return _edges_filename; }
+  const array<size_t, DNA_RADIX+1> & counts() const { return _counts; }
+
+  // Frees the node flags and removes the edges file (e.g. once the graph has been built from them)
+  void clear() {
+    int_vector<1>().swap(_first);
+    vector<uint8_t>().swap(_buffer);
+    if (_edges_file.is_open()) _edges_file.close();
+    if (!_edges_filename.empty()) remove(_edges_filename.c_str());
+    _edges_filename.clear();
+  }
+};
+
 template <typename Container>
 double bits_per_element(const Container & c) {
   return size_in_bytes(c) * 8.0 / c.size();
@@ -45,26 +45,132 @@ class debruijn_hypergraph {
     return node_type(i_prime, std::max(i_prime, j_prime), k);
   }
 
+  // The nodes longer(v, k) lists, found as the range is iterated: nothing is allocated, and a caller that stops early
+  // doesn't pay for the rest. The iterators point into the range, so it has to outlive them.
+  class longer_range {
+    public:
+    class const_iterator {
+      typedef typename lte_range<t_lcs_vector>::const_iterator starts_iterator;
+      static const size_t npos = lte_range<t_lcs_vector>::npos;
+
+      const longer_range * m_range;
+      starts_iterator      m_starts;       // the start after m_next
+      size_t               m_start = 0;
+      size_t               m_next  = 0;    // the start after m_start, or npos
+      bool                 m_final = true; // m_node is the last node
+      bool                 m_done  = true;
+      node_type            m_node;
+
+      // Each start up to the second to last begins a node that ends before the next start, then the last start
+      // begins the last node (or the range's own start if there are none)
+      void _set_node() {
+        m_final = (m_starts == m_range->m_starts.end());
+        if (!m_final) m_node = node_type(m_start, m_next-1, m_range->m_k);
+        else m_node = node_type(((m_next != npos)? m_next : m_start) - 1, m_range->m_last, m_range->m_k);
+      }
+
+      public:
+      typedef std::input_iterator_tag iterator_category;
+      typedef node_type               value_type;
+      typedef ptrdiff_t               difference_type;
+      typedef const node_type *       pointer;
+      typedef const node_type &       reference;
+
+      // end
+      const_iterator(const longer_range * range) : m_range(range), m_starts(range->m_starts.end()) {}
+
+      // begin
+      const_iterator(const longer_range * range, bool) : m_range(range), m_starts(range->m_starts.begin()),
+                                                         m_done(false) {
+        if (m_starts == m_range->m_starts.end()) {
+          m_node = node_type(m_range->m_first, m_range->m_last, m_range->m_k);
+          return;
+        }
+        m_start = *m_starts++;
+        m_next  = (m_starts != m_range->m_starts.end())? *m_starts++ : npos;
+        _set_node();
+      }
+
+      reference operator*() const { return m_node; }
+      pointer operator->() const { return &m_node; }
+
+      const_iterator & operator++() {
+        if (m_final) {
+          m_done = true;
+          return *this;
+        }
+        m_start = m_next;
+        m_next  = *m_starts++;
+        _set_node();
+        return *this;
+      }
+
+      bool operator==(const const_iterator & other) const {
+        return m_done == other.m_done && (m_done || m_node == other.m_node);
+      }
+      bool operator!=(const const_iterator & other) const { return !(*this == other); }
+    };
+
+    private:
+    lte_range<t_lcs_vector> m_starts;
+    edge_type               m_first;
+    edge_type               m_last;
+    size_t                  m_k;
+
+    public:
+    longer_range(const t_lcs_vector & lcs, const node_type & v, size_t k)
+      : m_starts(lcs, get<0>(v), get<1>(v), k-1), m_first(get<0>(v)), m_last(get<1>(v)), m_k(k) {}
+
+    const_iterator begin() const { return const_iterator(this, true); }
+    const_iterator end() const { return const_iterator(this); }
+  };
+
+  // The nodes backward(v) lists, found as the range is iterated (like longer_range)
+  class backward_range {
+    public:
+    class const_iterator {
+      const debruijn_hypergraph *            m_graph;
+      typename longer_range::const_iterator m_longer;
+      size_t                                 m_k;
+
+      public:
+      typedef std::input_iterator_tag iterator_category;
+      typedef node_type               value_type;
+      typedef ptrdiff_t               difference_type;
+      typedef const node_type *       pointer;
+      typedef node_type               reference;
+
+      const_iterator(const debruijn_hypergraph * graph, const typename longer_range::const_iterator & longer, size_t k)
+        : m_graph(graph), m_longer(longer), m_k(k) {}
+
+      reference operator*() const { return m_graph->_backward_node(*m_longer, m_k); }
+      const_iterator & operator++() { ++m_longer; return *this; }
+      bool operator==(const const_iterator & other) const { return m_longer == other.m_longer; }
+      bool operator!=(const const_iterator & other) const { return m_longer != other.m_longer; }
+    };
+
+    private:
+    const debruijn_hypergraph * m_graph;
+    longer_range                m_longer;
+    size_t                      m_k;
+
+    public:
+    backward_range(const debruijn_hypergraph * graph, const node_type & v)
+      : m_graph(graph), m_longer(graph->m_lcs, v, get<2>(v)+1), m_k(get<2>(v)) {}
+
+    const_iterator begin() const { return const_iterator(m_graph, m_longer.begin(), m_k); }
+    const_iterator end() const { return const_iterator(m_graph, m_longer.end(), m_k); }
+  };
+
   // longer(v, k) - list nodes (new "node") whose labels have length k <= K and end with v's label
-  // could make iterator instead
   vector<node_type> longer(const node_type & v, size_t k) const {
-    vector<node_type> longer_nodes;
-    size_t i = get<0>(v);
-    size_t j = get<1>(v);
-    auto starts = range_lte(m_lcs, i, j, k-1);
-    // add code to add first edge?
-    if (0 == starts.size()) {
-      longer_nodes.push_back(node_type(get<0>(v), get<1>(v), k));
-      return longer_nodes;
-    }
-    for (size_t idx = 1; idx < starts.size()-1; idx++) {
-      size_t start = starts[idx-1];
-      size_t end   = starts[idx]-1;
-      longer_nodes.push_back(node_type(start, end, k));
-    }
-    size_t last = starts[starts.size()-1];
-    longer_nodes.push_back(node_type(last-1, j, k));
-    return longer_nodes;
+    longer_range nodes = longer_nodes(v, k);
+    return vector<node_type>(nodes.begin(), nodes.end());
+  }
+
+  // Same as longer, but lazy
+  longer_range longer_nodes(const node_type & v, size_t k) const {
+    return longer_range(m_lcs, v, k);
   }
 
   symbol_type lastchar(const node_type& v) const {
@@ -90,20 +196,21 @@ class debruijn_hypergraph {
   }
 
   vector<node_type> backward(const node_type & v) const {
-    // This could be done lazily, and searched over...
-    //if (get<2>(v) == m_dbg.k-1) {} // do standard version - not needed?
-    auto l = longer(v, get<2>(v)+1);
-    // map maxlen to each element in l
-    transform(l.begin(), l.end(), l.begin(), [&](const node_type & u){ return maxlen(u); } );
-    // map standard dbg backward to each element
-    transform(l.begin(), l.end(), l.begin(), [&](const node_type & u){
-      size_t start = m_dbg._backward(get<0>(u));
-      size_t end   = m_dbg._last_edge_of_node(m_dbg._edge_to_node(start));
-      return node_type(start, end, get<2>(u));
-    });
-    // map shorter to each element
-    transform(l.begin(), l.end(), l.begin(), [&](const node_type & u){ return shorter(u, get<2>(v)); });
-    return l;
+    backward_range nodes = backward_nodes(v);
+    return vector<node_type>(nodes.begin(), nodes.end());
+  }
+
+  // Same as backward, but lazy
+  backward_range backward_nodes(const node_type & v) const {
+    return backward_range(this, v);
+  }
+
+  // u (from longer) mapped to its maxlen node, then the standard dbg backward of that, shortened to k
+  node_type _backward_node(const node_type & u, size_t k) const {
+    node_type top = maxlen(u);
+    size_t start  = m_dbg._backward(get<0>(top));
+    size_t end    = m_dbg._last_edge_of_node(m_dbg._edge_to_node(start));
+    return shorter(node_type(start, end, get<2>(top)), k);
   }
 
   // maxlen(v, x) - returns some node in the *original* (kmax) graph whose label ends with v's
@@ -121,19 +228,12 @@ class debruijn_hypergraph {
   optional<node_type> maxlen(const node_type & v, const symbol_type x) const {
     assert(x < m_dbg.sigma + 1);
     // For both flagged and nonflagged symbol in W
-    for (symbol_type flag : {0,1}) {
-      symbol_type x_with_flag = m_dbg._with_edge_flag(x, flag);
-      size_t prev_count = m_dbg.m_edges.rank(get<0>(v)+1, x_with_flag);
-      size_t most_recent = m_dbg.m_edges.select(prev_count, x_with_flag);
-      // check if edge falls outside our range...
-      if (get<0>(v) <= most_recent && most_recent <= get<1>(v)) {
-        // Find node range
-        size_t node_rank = m_dbg._edge_to_node(most_recent);
-        auto n_range = m_dbg._node_range(node_rank);
-        return optional<node_type>(node_type(get<0>(n_range), get<1>(n_range), m_dbg.k-1));
-      }
-    }
-    return optional<node_type>();
+    ssize_t most_recent = m_dbg._last_edge_labelled(get<0>(v), get<1>(v), x);
+    if (most_recent == -1) return optional<node_type>();
+    // Find node range
+    size_t node_rank = m_dbg._edge_to_node(most_recent);
+    auto n_range = m_dbg._node_range(node_rank);
+    return optional<node_type>(node_type(get<0>(n_range), get<1>(n_range), m_dbg.k-1));
   }
 
   // function to get standard node by rank (then use shorter)
@@ -9,6 +9,9 @@
 #include <utility>                                 // make_pair (for boost ranges)
 #include <functional>                              // function (to avoid errors with the lambdas)
 #include <cstring>                                 // memset
+#include <vector>
+#include <thread>
+#include <algorithm>                               // lower_bound
 
 #include "kmer.hpp"
 
@@ -16,8 +19,8 @@ using namespace boost::adaptors;
 
 enum edge_tag { standard, in_dummy, out_dummy };
 
-template <typename kmer_t, typename OutputIterator>
-void find_incoming_dummy_edges(const kmer_t * table_a, const kmer_t * table_b, size_t num_kmers, uint32_t k, OutputIterator out) {
+template <typename kmer_t, typename t_k, typename OutputIterator>
+void find_incoming_dummy_edges(const kmer_t * table_a, const kmer_t * table_b, size_t num_kmers, t_k k, OutputIterator out) {
   auto a_range = std::make_pair(table_a, table_a + num_kmers);
   auto b_range = std::make_pair(table_b, table_b + num_kmers);
   auto a_lam   = std::function<kmer_t(kmer_t)>([](kmer_t x) -> kmer_t {return get_start_node(x);});
@@ -30,8 +33,76 @@ void find_incoming_dummy_edges(const kmer_t * table_a, const kmer_t * table_b, s
   boost::set_difference(a, b, out);
 }
 
+// Same as find_incoming_dummy_edges, but only indexes the tables in increasing order
+// (for tables that are streamed rather than stored in arrays).
+template <typename kmer_t, class TableA, class TableB, typename t_k, typename OutputIterator>
+void find_incoming_dummy_edges_sequential(TableA & table_a, TableB & table_b, size_t num_kmers, t_k k, OutputIterator out) {
+  size_t a_idx = 0, b_idx = 0;
+  while (a_idx < num_kmers) {
+    kmer_t a = get_start_node(kmer_t(table_a[a_idx]));
+    while (b_idx < num_kmers && get_end_node(kmer_t(table_b[b_idx]), k) < a) b_idx++;
+    if (b_idx == num_kmers || get_end_node(kmer_t(table_b[b_idx]), k) != a) *out++ = a;
+    // skip the other edges of this node
+    while (a_idx < num_kmers && get_start_node(kmer_t(table_a[a_idx])) == a) a_idx++;
+  }
+}
+
+// Gives table B (colex(row) order) from table A (<colex(node), edge> order) without storing a second table.
+// The rows of table A with edge label c are already sorted by the rest of the row, so table B is just the rows
+// with edge label 0, then the rows with label 1, etc. (much like the LF mapping of a BWT).
+// The edge labels are kept in a packed vector (2 bits per row) so each label scan doesn't touch the full table.
+// Like the merged runs, it can only be indexed in increasing order.
 template <typename kmer_t>
-size_t count_incoming_dummy_edges(kmer_t * table_a, kmer_t * table_b, size_t num_kmers, uint32_t k) {
+class colex_row_view {
+  const kmer_t * _table_a;
+  const std::vector<uint8_t> & _labels;
+  size_t  _num_records;
+  uint8_t _c = 0;      // label of the current row
+  size_t  _a_idx = 0;  // position of the current row in table A
+  size_t  _idx = 0;
+  kmer_t  _current;
+
+  uint8_t _label(size_t i) const { return (_labels[i/4] >> (2 * (i%4))) & 3; }
+
+  // Move to the next row (at or after _a_idx) with label _c, or the next label if there are none
+  void _seek() {
+    while (_c < DNA_RADIX) {
+      while (_a_idx < _num_records && _label(_a_idx) != _c) _a_idx++;
+      if (_a_idx < _num_records) {
+        _current = _table_a[_a_idx];
+        return;
+      }
+      _c++;
+      _a_idx = 0;
+    }
+    _current = kmer_t();
+  }
+
+  public:
+  colex_row_view(const kmer_t * table_a, size_t num_records, const std::vector<uint8_t> & labels)
+    : _table_a(table_a), _labels(labels), _num_records(num_records) {
+    _seek();
+  }
+
+  // The packed edge labels of table A (to be shared between views)
+  static std::vector<uint8_t> edge_labels(const kmer_t * table_a, size_t num_records) {
+    std::vector<uint8_t> labels((num_records + 3)/4, 0);
+    for (size_t i = 0; i < num_records; i++) labels[i/4] |= get_edge_label(table_a[i]) << (2 * (i%4));
+    return labels;
+  }
+
+  kmer_t operator[](size_t i) {
+    assert(i >= _idx);
+    for (; _idx < i; _idx++) {
+      _a_idx++;
+      _seek();
+    }
+    return _current;
+  }
+};
+
+template <typename kmer_t, typename t_k>
+size_t count_incoming_dummy_edges(kmer_t * table_a, kmer_t * table_b, size_t num_kmers, t_k k) {
   size_t count = 0;
 
   auto inc_count = [&count](kmer_t) {count++;};
@@ -74,20 +145,20 @@ void prepare_incoming_dummy_edges(kmer_t * dummy_nodes, uint8_t * k_values, size
   prepare_k_values(k_values, num_dummies, k);
 }
 
-template <class Visitor>
+// The flaggers below keep their state as members (rather than statics), so that each merge
+// (or each slice of a parallel merge) can have its own.
+template <typename kmer_t, class Visitor>
 class Unique {
   Visitor _v;
   bool first_iter = true;
   edge_tag last_tag;
+  kmer_t last_kmer;
   uint32_t last_k;
 
   public:
     Unique(Visitor v) : _v(v) {}
 
-    template <typename kmer_t>
     void operator()(edge_tag tag, const kmer_t & x, uint32_t k) {
-      static kmer_t last_kmer;
-
       if (first_iter || tag != last_tag || x != last_kmer || k != last_k) {
         _v(tag, x, k);
       }
@@ -95,23 +166,25 @@ class Unique {
       last_tag = tag;
       last_kmer = x;
       last_k = k;
-    };
+    }
 };
 
-template <class Visitor>
+template <typename kmer_t, class Visitor, typename t_k = uint32_t>
 class FirstStartNodeFlagger {
   Visitor _v;
-  uint32_t _graph_k;
+  t_k _graph_k;
+  uint32_t last_k = 0;
+#ifdef VAR_ORDER
+  kmer_t last_edge = 0;
+#else
+  kmer_t last_start_node = 0;
+  bool first_iter = true;
+#endif
 
   public:
-    FirstStartNodeFlagger(Visitor v, uint32_t k) : _v(v), _graph_k(k) {}
-    template <typename kmer_t>
+    FirstStartNodeFlagger(Visitor v, t_k k) : _v(v), _graph_k(k) {}
     void operator()(edge_tag tag, const kmer_t & x, const uint32_t k) {
-      // Note: for multithreading, this might be dangerous? could make class members instead
-      static uint32_t last_k = 0;
-
 #ifdef VAR_ORDER
-      static kmer_t last_edge = 0;
       size_t result = node_lcs(x, last_edge, std::min(k, last_k));
       // If dummy edge length is equal, and the LCS length is the length of the non-dummy suffix,
       // include the $ signs as well
@@ -122,8 +195,6 @@ class FirstStartNodeFlagger {
       //std::cerr << "kmer: " << kmer_to_string(x,k) << std::endl;
       //std::cerr << "lcs: " << result << std::endl;
 #else
-      static kmer_t last_start_node = 0;
-      static bool first_iter = true;
       kmer_t this_start_node = get_start_node(x);
       size_t result = (first_iter || this_start_node != last_start_node || k != last_k);
       first_iter = false;
@@ -135,27 +206,24 @@ class FirstStartNodeFlagger {
     }
 };
 
-template <class Visitor>
+template <typename kmer_t, class Visitor, typename t_k = uint32_t>
 class FirstEndNodeFlagger {
   Visitor  _v;
-  uint32_t _graph_k;
+  t_k      _graph_k;
   bool first_iter = true;
+  kmer_t last_suffix = 0;
+  uint32_t last_k = 0;
+  bool edge_seen[DNA_RADIX];
 
   public:
-    FirstEndNodeFlagger(Visitor v, uint32_t k) : _v(v), _graph_k(k) {}
-    template <typename kmer_t>
+    FirstEndNodeFlagger(Visitor v, t_k k) : _v(v), _graph_k(k) {}
     void operator()(edge_tag tag, const kmer_t & x, const uint32_t k, uint32_t start_node_flag) {
-      static kmer_t last_suffix;
-      static uint32_t last_k;
-      static bool edge_seen[DNA_RADIX];
-      #define reset_flags() memset(edge_seen, 0, DNA_RADIX)
-
       bool edge_flag = true;
       kmer_t this_suffix = get_start_node_suffix(x, _graph_k);
 
       // reset "edge seen" flags
       if (this_suffix != last_suffix || k != last_k || first_iter) {
-        reset_flags();
+        memset(edge_seen, 0, DNA_RADIX);
         edge_flag = true;
         first_iter = false;
       }
@@ -173,19 +241,26 @@ class FirstEndNodeFlagger {
     }
 };
 
-template <class Visitor>
-auto uniquify(Visitor v) -> Unique<decltype(v)> {
-  return Unique<decltype(v)>(v);
+template <typename kmer_t, class Visitor>
+auto uniquify(Visitor v) -> Unique<kmer_t, decltype(v)> {
+  return Unique<kmer_t, decltype(v)>(v);
+}
+
+template <typename kmer_t, class Visitor, typename t_k>
+auto add_first_start_node_flag(Visitor v, t_k k) -> FirstStartNodeFlagger<kmer_t, decltype(v), t_k> {
+  return FirstStartNodeFlagger<kmer_t, decltype(v), t_k>(v, k);
 }
 
-template <class Visitor>
-auto add_first_start_node_flag(Visitor v, uint32_t k) -> FirstStartNodeFlagger<decltype(v)> {
-  return FirstStartNodeFlagger<decltype(v)>(v, k);
+template <typename kmer_t, class Visitor, typename t_k>
+auto add_first_end_node_flag(Visitor v, t_k k) -> FirstEndNodeFlagger<kmer_t, decltype(v), t_k> {
+  return FirstEndNodeFlagger<kmer_t, decltype(v), t_k>(v, k);
 }
 
-template <class Visitor>
-auto add_first_end_node_flag(Visitor v, uint32_t k) -> FirstEndNodeFlagger<decltype(v)> {
-  return FirstEndNodeFlagger<decltype(v)>(v, k);
+// The full flagging pipeline that merge_dummies sends each edge through
+template <typename kmer_t, class Visitor, typename t_k>
+auto make_edge_flagger(Visitor v, t_k k)
+  -> decltype(uniquify<kmer_t>(add_first_start_node_flag<kmer_t>(add_first_end_node_flag<kmer_t>(v, k), k))) {
+  return uniquify<kmer_t>(add_first_start_node_flag<kmer_t>(add_first_end_node_flag<kmer_t>(v, k), k));
 }
 
 // Could be done cleaner: set_difference iterator as outgoing dummies, transform to have tuple with k value, merge + merge again iterator with comp functor.
@@ -194,16 +269,17 @@ auto add_first_end_node_flag(Visitor v, uint32_t k) -> FirstEndNodeFlagger<declt
 // Visitor functor takes 4 params: kmer, size, first flag, edge flag (could also just take kmer and size)
 // planned Visitor functors: ascii_full_edge, ascii_edge_only, binary (5 bits per row, x12 per 64 bit block, 4 bits waste per 12, or just per 8 bits at
 // first to make parsing easy)
-template <typename kmer_t, class Visitor>
-void merge_dummies(kmer_t * table_a, kmer_t * table_b, const size_t num_records, const uint32_t k,
-                   kmer_t * in_dummies, size_t num_incoming_dummies, uint8_t * dummy_lengths,
-                   Visitor visitor_f) {
+// table_a and table_b only need to support indexing in increasing order (so they can be streamed from disk).
+// Unlike merge_dummies, visit is the flagging pipeline (see make_edge_flagger), and the tables can be different lengths
+// (e.g. slices of the full tables).
+template <class TableA, class TableB, typename kmer_t, typename t_k, class Visitor>
+void merge_dummies_with(TableA & table_a, const size_t num_a, TableB & table_b, const size_t num_b, const t_k k,
+                        const kmer_t * in_dummies, size_t num_incoming_dummies, const uint8_t * dummy_lengths,
+                        Visitor & visit) {
   // runtime speed: O(num_records) (since num_records >= num_incoming_dummies)
-  auto visit = uniquify(add_first_start_node_flag(add_first_end_node_flag(visitor_f, k),k));
-
-  #define get_a(i) (get_start_node(table_a[(i)]) >> 2)
-  #define get_b(i) (get_end_node(table_b[(i)], k) >> 2) // shifting to give dummy check call consistency
-  #define inc_b() while (b_idx < num_records && get_b(++b_idx) == b) {}
+  #define get_a(i) (get_start_node(kmer_t(table_a[(i)])) >> 2)
+  #define get_b(i) (get_end_node(kmer_t(table_b[(i)]), k) >> 2) // shifting to give dummy check call consistency
+  #define inc_b() while (++b_idx < num_b && get_b(b_idx) == b) {}
 
   // **Standard edges**: Table a (already sorted by colex(node), then edge).
   // Table a May not be unique (if k is odd and had "palindromic" [in DNA sense] kmer in input)
@@ -228,7 +304,7 @@ void merge_dummies(kmer_t * table_a, kmer_t * table_b, const size_t num_records,
   // then print all remaining if either one is depleted
   // at each print, visit all in_dummies < this
   // visit(standard, table_a[a_idx++], k);
-  while (a_idx < num_records && b_idx < num_records) {
+  while (a_idx < num_a && b_idx < num_b) {
     kmer_t x = table_a[a_idx];
     kmer_t a = get_a(a_idx);
     kmer_t b = get_b(b_idx);
@@ -253,14 +329,14 @@ void merge_dummies(kmer_t * table_a, kmer_t * table_b, const size_t num_records,
   }
 
   // Might have entries in a even if b is depleted (e.g. if all b < a)
-  while (a_idx < num_records) {
+  while (a_idx < num_a) {
     kmer_t x = table_a[a_idx++];
     check_for_in_dummies(x);
     visit(standard, x, k);
   }
 
   // Might have entries in b even if a is depleted
-  while (b_idx < num_records) {
+  while (b_idx < num_b) {
     kmer_t b = get_b(b_idx++);
     check_for_in_dummies(b);
     visit(out_dummy, b, k);
@@ -271,6 +347,107 @@ void merge_dummies(kmer_t * table_a, kmer_t * table_b, const size_t num_records,
     visit(in_dummy, in_dummies[d_idx], dummy_lengths[d_idx]);
     ++d_idx;
   }
+  #undef get_a
+  #undef get_b
+  #undef inc_b
+  #undef check_for_in_dummies
+}
+
+template <class TableA, class TableB, typename kmer_t, typename t_k, class Visitor>
+void merge_dummies(TableA & table_a, TableB & table_b, const size_t num_records, const t_k k,
+                   const kmer_t * in_dummies, size_t num_incoming_dummies, const uint8_t * dummy_lengths,
+                   Visitor visitor_f) {
+  auto visit = make_edge_flagger<kmer_t>(visitor_f, k);
+  merge_dummies_with(table_a, num_records, table_b, num_records, k, in_dummies, num_incoming_dummies, dummy_lengths, visit);
+}
+
+// A flagged edge, as passed to a merge_dummies visitor (used to buffer the output of each slice in parallel_merge_dummies)
+template <typename kmer_t>
+struct flagged_edge {
+  edge_tag tag;
+  kmer_t   x;
+  uint32_t k;
+  size_t   first_start_node;
+  bool     first_end_node;
+};
+
+// Same output as merge_dummies, but for arrays: splits table_a, table_b and in_dummies into slices by node
+// (never splitting a group of nodes with the same suffix, so the end node flags don't depend on other slices),
+// merges up to num_threads slices at a time, each with its own flagger state, then visits them in order.
+// The only flag that can depend on the previous slice is the first start node flag (or LCS) of the first
+// edge in a slice, which is recomputed from the last edge of the previous slice.
+template <typename kmer_t, typename t_k, class Visitor>
+void parallel_merge_dummies(const kmer_t * table_a, const kmer_t * table_b, const size_t num_records, const t_k k,
+                            const kmer_t * in_dummies, size_t num_incoming_dummies, const uint8_t * dummy_lengths,
+                            Visitor visitor_f, size_t num_threads, size_t slice_size = (1 << 18)) {
+  if (num_threads <= 1 || num_records <= slice_size) {
+    merge_dummies(table_a, table_b, num_records, k, in_dummies, num_incoming_dummies, dummy_lengths, visitor_f);
+    return;
+  }
+
+  // Slice s covers the nodes in [p_s, p_{s+1}), where each p is the smallest node with some suffix
+  std::vector<size_t> a_starts(1, 0), b_starts(1, 0), d_starts(1, 0);
+  for (size_t i = slice_size; i < num_records; i += slice_size) {
+    kmer_t p = clear_nt(get_start_node(table_a[i]), k-2);
+    size_t a_i = std::lower_bound(table_a, table_a + num_records, p,
+                                  [](const kmer_t & x, const kmer_t & y) { return get_start_node(x) < y; }) - table_a;
+    if (a_i <= a_starts.back()) continue;
+    size_t b_i = std::lower_bound(table_b, table_b + num_records, p,
+                                  [k](const kmer_t & x, const kmer_t & y) { return get_end_node(x, k) < y; }) - table_b;
+    // merge_dummies visits an in-dummy once it has seen something at least as large, so the previous slice
+    // gets every in-dummy up to the first one past its last node
+    kmer_t last_node = get_start_node(table_a[a_i-1]);
+    if (b_i > b_starts.back()) last_node = std::max(last_node, get_end_node(table_b[b_i-1], k));
+    size_t d_i = d_starts.back();
+    while (d_i < num_incoming_dummies && kmer_t(in_dummies[d_i] << 2) <= last_node) ++d_i;
+    a_starts.push_back(a_i);
+    b_starts.push_back(b_i);
+    d_starts.push_back(d_i);
+  }
+  a_starts.push_back(num_records);
+  b_starts.push_back(num_records);
+  d_starts.push_back(num_incoming_dummies);
+  size_t num_slices = a_starts.size() - 1;
+
+  std::vector<std::vector<flagged_edge<kmer_t>>> buffers(std::min(num_threads, num_slices));
+  flagged_edge<kmer_t> last = flagged_edge<kmer_t>();
+  for (size_t first_slice = 0; first_slice < num_slices; first_slice += buffers.size()) {
+    size_t wave_size = std::min(buffers.size(), num_slices - first_slice);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < wave_size; ++t) {
+      threads.push_back(std::thread([&, t]() {
+        size_t s = first_slice + t;
+        std::vector<flagged_edge<kmer_t>> & buffer = buffers[t];
+        buffer.clear();
+        auto visit = make_edge_flagger<kmer_t>([&buffer](edge_tag tag, const kmer_t & x, const uint32_t x_k,
+                                                         size_t first_start_node, bool first_end_node) {
+          buffer.push_back(flagged_edge<kmer_t>{tag, x, x_k, first_start_node, first_end_node});
+        }, k);
+        const kmer_t * slice_a = table_a + a_starts[s];
+        const kmer_t * slice_b = table_b + b_starts[s];
+        merge_dummies_with(slice_a, a_starts[s+1] - a_starts[s], slice_b, b_starts[s+1] - b_starts[s], k,
+                           in_dummies + d_starts[s], d_starts[s+1] - d_starts[s], dummy_lengths + d_starts[s], visit);
+      }));
+    }
+    for (auto & thread : threads) thread.join();
+
+    for (size_t t = 0; t < wave_size; ++t) {
+      std::vector<flagged_edge<kmer_t>> & buffer = buffers[t];
+      if (first_slice + t > 0) {
+        size_t first_start_node = 0;
+        auto flag = add_first_start_node_flag<kmer_t>([&first_start_node](edge_tag, const kmer_t &, const uint32_t, size_t f) {
+          first_start_node = f;
+        }, k);
+        flag(last.tag, last.x, last.k);
+        flag(buffer[0].tag, buffer[0].x, buffer[0].k);
+        buffer[0].first_start_node = first_start_node;
+      }
+      for (const flagged_edge<kmer_t> & e : buffer) {
+        visitor_f(e.tag, e.x, e.k, e.first_start_node, e.first_end_node);
+      }
+      last = buffer.back();
+    }
+  }
 }
 
 template <typename kmer_t>
@@ -0,0 +1,254 @@
+#pragma once
+#ifndef _EDGE_VECTOR_HPP
+#define _EDGE_VECTOR_HPP
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+
+#include <sdsl/int_vector.hpp>
+
+#include "utility.hpp"
+#include "debruijn_graph.hpp"
+
+using namespace std;
+using namespace sdsl;
+
+// Alternative to wt_huff for the edges (W) of a debruijn_graph, for small alphabets (t_num_symbols codes, default 10:
+// the 4 nucleotides and $, each with or without the minus flag).
+//
+// The sequence is cut into 64 byte lines (one cache line each). A line starts with the counts of every code before
+// the line (12 bits each, relative to its superblock of lines_per_super lines), followed by 4-bit symbols. So rank is
+// one line plus a (small, usually cached) superblock count, and is answered with popcounts inside the line.
+// select is helped by the position of every sample_rate-th occurrence of each code.
+template <size_t t_num_symbols = 10>
+class interleaved_edge_vector {
+  static_assert(t_num_symbols <= 16, "Symbols are stored in 4 bits.");
+
+  public:
+  typedef uint64_t size_type;
+  typedef uint8_t  value_type;
+
+  static const size_t line_words        = 8;
+  static const size_t count_bits        = 12;
+  static const size_t counts_per_word   = 64 / count_bits;
+  static const size_t header_words      = (t_num_symbols + counts_per_word - 1) / counts_per_word;
+  static const size_t symbols_per_word  = 16;
+  static const size_t symbols_per_line  = (line_words - header_words) * symbols_per_word;
+  static const size_t lines_per_super   = 32;
+  static const size_t sample_rate       = 128;
+  static const uint64_t nibble_ones     = 0x1111111111111111ULL;
+  static_assert(header_words < line_words, "Too many symbols for the line header.");
+  static_assert((lines_per_super - 1) * symbols_per_line < (1 << count_bits), "Superblocks too large for the counts.");
+
+  private:
+  size_type     m_size = 0;
+  int_vector<64> m_lines;
+  int_vector<64> m_super_counts; // t_num_symbols counts before each superblock (and the totals at the end)
+  int_vector<32> m_samples;      // line of the (s*sample_rate+1)-th occurrence, for each code in turn
+  array<uint64_t, t_num_symbols+1> m_sample_starts{};
+
+  // bitmask with bit 4j set if symbol j of x is c
+  static uint64_t _matches(uint64_t x, value_type c) {
+    uint64_t y = x ^ (c * nibble_ones);
+    return ~(y | (y >> 1) | (y >> 2) | (y >> 3)) & nibble_ones;
+  }
+
+  // mask of the nibbles 0..t of a word
+  static uint64_t _nibbles_upto(size_t t) { return (t >= symbols_per_word - 1)? ~0ULL : (1ULL << (4 * (t+1))) - 1; }
+
+  static size_t _num_lines(size_t n) { return (n + symbols_per_line - 1) / symbols_per_line; }
+
+  const uint64_t * _line(size_t l) const { return m_lines.data() + l * line_words; }
+
+  // occurrences of c before line l
+  size_t _before_line(size_t l, value_type c) const {
+    size_t relative = (_line(l)[c / counts_per_word] >> (count_bits * (c % counts_per_word))) & ((1 << count_bits) - 1);
+    return m_super_counts[(l / lines_per_super) * t_num_symbols + c] + relative;
+  }
+
+  public:
+  interleaved_edge_vector() {}
+
+  // access(i) gives the i-th symbol for i in [0, n)
+  template <class Access>
+  interleaved_edge_vector(size_t n, Access access) : m_size(n) {
+    size_t num_lines = _num_lines(n);
+    m_lines = int_vector<64>(num_lines * line_words, 0);
+    m_super_counts = int_vector<64>((num_lines / lines_per_super + 1) * t_num_symbols + t_num_symbols, 0);
+    array<uint64_t, t_num_symbols> counts{};
+    array<uint64_t, t_num_symbols> super_start{};
+    vector<vector<uint32_t>> samples(t_num_symbols);
+    for (size_t l = 0; l < num_lines; l++) {
+      uint64_t * line = m_lines.data() + l * line_words;
+      if (l % lines_per_super == 0) {
+        super_start = counts;
+        for (size_t c = 0; c < t_num_symbols; c++) m_super_counts[(l / lines_per_super) * t_num_symbols + c] = counts[c];
+      }
+      for (size_t c = 0; c < t_num_symbols; c++) {
+        line[c / counts_per_word] |= (counts[c] - super_start[c]) << (count_bits * (c % counts_per_word));
+      }
+      for (size_t i = l * symbols_per_line; i < std::min(n, (l+1) * symbols_per_line); i++) {
+        value_type c = access(i);
+        if (c >= t_num_symbols) throw runtime_error("Symbol out of range for interleaved_edge_vector");
+        if (counts[c] % sample_rate == 0) samples[c].push_back(l);
+        counts[c]++;
+        size_t offset = i - l * symbols_per_line;
+        line[header_words + offset / symbols_per_word] |= (uint64_t)c << (4 * (offset % symbols_per_word));
+      }
+    }
+    // the totals, so that select can bound its search without special cases
+    for (size_t c = 0; c < t_num_symbols; c++) m_super_counts[m_super_counts.size() - t_num_symbols + c] = counts[c];
+
+    for (size_t c = 0; c < t_num_symbols; c++) m_sample_starts[c+1] = m_sample_starts[c] + samples[c].size();
+    m_samples = int_vector<32>(m_sample_starts[t_num_symbols], 0);
+    for (size_t c = 0; c < t_num_symbols; c++) {
+      std::copy(samples[c].begin(), samples[c].end(), m_samples.begin() + m_sample_starts[c]);
+    }
+  }
+
+  size_type size() const { return m_size; }
+
+  value_type operator[](size_type i) const {
+    size_t offset = i % symbols_per_line;
+    return (_line(i / symbols_per_line)[header_words + offset / symbols_per_word] >> (4 * (offset % symbols_per_word))) & 0xF;
+  }
+
+  // occurrences of c in [0, i)
+  size_type rank(size_type i, value_type c) const {
+    if (c >= t_num_symbols) return 0;
+    size_t l = i / symbols_per_line;
+    if (l == _num_lines(m_size)) return m_super_counts[m_super_counts.size() - t_num_symbols + c];
+    const uint64_t * data = _line(l) + header_words;
+    size_t offset = i - l * symbols_per_line;
+    size_t r = _before_line(l, c);
+    for (size_t w = 0; w < offset / symbols_per_word; w++) r += __builtin_popcountll(_matches(data[w], c));
+    if (offset % symbols_per_word) {
+      r += __builtin_popcountll(_matches(data[offset / symbols_per_word], c) &
+                                ((1ULL << (4 * (offset % symbols_per_word))) - 1));
+    }
+    return r;
+  }
+
+  // position of the j-th (1-based) occurrence of c, or size() if there isn't one
+  size_type select(size_type j, value_type c) const {
+    if (c >= t_num_symbols || j == 0 || j > m_super_counts[m_super_counts.size() - t_num_symbols + c]) return m_size;
+    // the sampled lines bound the last line with fewer than j occurrences before it
+    size_t s  = m_sample_starts[c] + (j-1) / sample_rate;
+    size_t lo = m_samples[s];
+    size_t hi = (s+1 < m_sample_starts[c+1])? m_samples[s+1] : _num_lines(m_size) - 1;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo + 1)/2;
+      if (_before_line(mid, c) < j) lo = mid;
+      else hi = mid - 1;
+    }
+    j -= _before_line(lo, c);
+    const uint64_t * data = _line(lo) + header_words;
+    for (size_t w = 0; ; w++) {
+      uint64_t m = _matches(data[w], c);
+      size_t count = __builtin_popcountll(m);
+      if (count >= j) return lo * symbols_per_line + w * symbols_per_word + _select_in_word(m, j-1) / 4;
+      j -= count;
+    }
+  }
+
+  // Largest p in [lower, i] holding c or d, or size() if there isn't one. For W, c and d are a symbol with and
+  // without the minus flag, so this finds the edge with a given label in a node (outgoing) in one pass: the line of
+  // i (and the one before) is scanned directly, and only a longer range falls back to rank and select.
+  size_type prev_occurrence(size_type i, value_type c, value_type d, size_type lower = 0) const {
+    size_t l = i / symbols_per_line;
+    size_t scan_start = std::max((size_t)lower, (l > 0)? (l-1) * symbols_per_line : 0);
+    for (size_t p = i+1; p > scan_start;) {
+      size_t q = p-1;
+      size_t offset = q % symbols_per_line;
+      size_t word_start = q - offset % symbols_per_word;
+      uint64_t word = _line(q / symbols_per_line)[header_words + offset / symbols_per_word];
+      uint64_t m = (_matches(word, c) | _matches(word, d)) & _nibbles_upto(q - word_start);
+      if (scan_start > word_start) m &= ~_nibbles_upto(scan_start - word_start - 1);
+      if (m) return word_start + (63 - __builtin_clzll(m)) / 4;
+      p = word_start;
+    }
+    if (scan_start == lower) return m_size;
+    size_t best = m_size;
+    for (value_type e : {c, d}) {
+      size_t r = rank(scan_start, e);
+      if (r == 0) continue;
+      size_t pos = select(r, e);
+      if (pos >= lower && (best == m_size || pos > best)) best = pos;
+    }
+    return best;
+  }
+
+  // touches the line that rank(i, c) and operator[](i) will read (see PREFETCH in utility.hpp)
+  void prefetch(size_t i) const {
+    __builtin_prefetch(_line(i / symbols_per_line));
+  }
+
+  void swap(interleaved_edge_vector & other) {
+    std::swap(m_size, other.m_size);
+    m_lines.swap(other.m_lines);
+    m_super_counts.swap(other.m_super_counts);
+    m_samples.swap(other.m_samples);
+    std::swap(m_sample_starts, other.m_sample_starts);
+  }
+
+  size_type serialize(ostream & out, structure_tree_node * v = nullptr, string name = "") const {
+    structure_tree_node * child = structure_tree::add_child(v, name, util::class_name(*this));
+    size_type written_bytes = 0;
+    written_bytes += write_member(m_size, out, child, "size");
+    written_bytes += m_lines.serialize(out, child, "lines");
+    written_bytes += m_super_counts.serialize(out, child, "super_counts");
+    written_bytes += m_samples.serialize(out, child, "samples");
+    written_bytes += write_member(m_sample_starts, out, child, "sample_starts");
+    structure_tree::add_size(child, written_bytes);
+    return written_bytes;
+  }
+
+  void load(istream & in) {
+    read_member(m_size, in);
+    m_lines.load(in);
+    m_super_counts.load(in);
+    m_samples.load(in);
+    read_member(m_sample_starts, in);
+  }
+};
+
+// So debruijn_graph::load_from_edges and load_from_packed_edges can build one like they build a wavelet tree
+template <size_t t_num_symbols>
+void construct_im(interleaved_edge_vector<t_num_symbols> & v, const int_vector<8> & data, uint8_t = 0) {
+  interleaved_edge_vector<t_num_symbols> tmp(data.size(), [&](size_t i) { return data[i]; });
+  v.swap(tmp);
+}
+
+// file holds num_bytes = 1 byte symbols (as written by load_from_packed_edges), which are read a chunk at a time
+// (the constructor asks for them in order), so the symbols are never all in memory next to the lines
+template <size_t t_num_symbols>
+void construct(interleaved_edge_vector<t_num_symbols> & v, const string & file, uint8_t num_bytes) {
+  if (num_bytes != 1) throw runtime_error("interleaved_edge_vector can only be constructed from bytes");
+  ifstream in(file, ios::in | ios::binary | ios::ate);
+  if (!in) throw runtime_error("Can't open " + file);
+  size_t n = in.tellg();
+  in.seekg(0, ios::beg);
+  const size_t chunk_size = 1 << 20;
+  vector<char> chunk(std::min(n, chunk_size));
+  size_t chunk_start = 0, chunk_end = 0;
+  interleaved_edge_vector<t_num_symbols> tmp(n, [&](size_t i) {
+    if (i >= chunk_end) {
+      assert(i == chunk_end);
+      chunk_start = chunk_end;
+      size_t len = std::min(chunk.size(), n - chunk_start);
+      if (!in.read(chunk.data(), len)) throw runtime_error("Error reading " + file);
+      chunk_end = chunk_start + len;
+    }
+    return (uint8_t)chunk[i - chunk_start];
+  });
+  v.swap(tmp);
+}
+
+typedef debruijn_graph<4, sd_vector<>, sd_vector<>::rank_0_type, sd_vector<>::select_0_type,
+                       interleaved_edge_vector<>> interleaved_debruijn_graph;
+
+#endif
@@ -22,9 +22,8 @@ int dsk_num_records(int handle, uint32_t kmer_num_bits, size_t * num_records) {
 
 // Only doing this complicated stuff to hopefully get rid of the counts in an efficient way
 // (that is, read a large chunk of the file including the counts, then discard them)
-size_t dsk_read_kmers(int handle, uint32_t kmer_num_bits, uint64_t * kmers_output) {
-  // TODO: Add a parameter to specify a limit to how many records we read (eventually multipass merge-sort?)
-  // THIS IS ALSO A SECURITY CONCERN if we don't trust the DSK input (i.e. e.g. accept DSK files in a web service)
+size_t dsk_read_kmers(int handle, uint32_t kmer_num_bits, uint64_t * kmers_output, size_t max_records) {
+  // THIS IS A SECURITY CONCERN if we don't trust the DSK input (i.e. e.g. accept DSK files in a web service)
 
   // read the items items into the array via a buffer
   char input_buffer[BUFFER_SIZE];
@@ -36,14 +35,17 @@ size_t dsk_read_kmers(int handle, uint32_t kmer_num_bits, uint64_t * kmers_outpu
 
   ssize_t num_bytes_read = 0;
   size_t next_slot = 0;
+  // Stop after max_records (if given), so big files can be read a chunk at a time
+  size_t bytes_left = (max_records)? max_records * record_size : SIZE_MAX;
 
   // This if statement would be more readable inside the loop, but it's moved out here for performance.
   if (kmer_num_bits <= 64) {
     do {
       // Try read a batch of records.
-      if ( (num_bytes_read = read(handle, input_buffer, read_size)) == -1 ) {
+      if ( (num_bytes_read = read(handle, input_buffer, std::min(read_size, bytes_left))) == -1 ) {
         return 0;
       }
+      bytes_left -= num_bytes_read;
 
       // Did we read anything?
       if (num_bytes_read ) {
@@ -54,25 +56,96 @@ size_t dsk_read_kmers(int handle, uint32_t kmer_num_bits, uint64_t * kmers_outpu
       }
     } while ( num_bytes_read );
   }
-  else if (64 < kmer_num_bits && kmer_num_bits <= 128) {
+  else if (64 < kmer_num_bits && kmer_num_bits <= MAX_BITS_PER_KMER) {
+    size_t num_blocks = (kmer_num_bits/8)/sizeof(uint64_t);
     do {
       // Try read a batch of records.
-      if ( (num_bytes_read = read(handle, input_buffer, read_size)) == -1 ) {
+      if ( (num_bytes_read = read(handle, input_buffer, std::min(read_size, bytes_left))) == -1 ) {
         return 0;
       }
+      bytes_left -= num_bytes_read;
 
       // Did we read anything?
       if (num_bytes_read ) {
         // Iterate over kmers, skipping counts
-        for (ssize_t offset = 0; offset < num_bytes_read; offset += 2 * sizeof(uint64_t) + sizeof(uint32_t), next_slot += 2) {
-            // Swapping lower and upper block (to simplify sorting later)
-            kmers_output[next_slot + 1] = *((uint64_t*)(input_buffer + offset));
-            kmers_output[next_slot]     = *((uint64_t*)(input_buffer + offset + sizeof(uint64_t)));
+        for (ssize_t offset = 0; offset < num_bytes_read; offset += record_size, next_slot += num_blocks) {
+            // Reversing the order of the blocks, so the upper one is first (to simplify sorting later)
+            for (size_t b = 0; b < num_blocks; b++) {
+              kmers_output[next_slot + num_blocks - 1 - b] = *((uint64_t*)(input_buffer + offset + b * sizeof(uint64_t)));
+            }
         }
       }
     } while ( num_bytes_read );
   }
-  else assert (kmer_num_bits <= 128);
-  // Return the number of kmers read (whether 64 bit or 128 bit)
+  else assert (kmer_num_bits <= MAX_BITS_PER_KMER);
+  // Return the number of kmers read (whatever their width)
   return next_slot / ((kmer_num_bits/8)/sizeof(uint64_t));
 }
+
+// Copies the kmers of records [lo, hi) out of a mapped DSK file, skipping counts.
+// memcpy is used since the records are only 4 byte aligned (the compiler turns these into plain loads).
+static void dsk_extract_kmers(const char * records, uint32_t kmer_num_bits, uint64_t * kmers_output, size_t lo, size_t hi) {
+  size_t record_size = DSK_FILE_RECORD_SIZE(kmer_num_bits);
+  const char * p = records + lo * record_size;
+  if (kmer_num_bits <= 64) {
+    for (size_t i = lo; i < hi; i++, p += record_size) {
+      memcpy(kmers_output + i, p, sizeof(uint64_t));
+    }
+  }
+  else {
+    size_t num_blocks = (kmer_num_bits/8)/sizeof(uint64_t);
+    for (size_t i = lo; i < hi; i++, p += record_size) {
+      // Reversing the order of the blocks, so the upper one is first (to simplify sorting later)
+      for (size_t b = 0; b < num_blocks; b++) {
+        memcpy(kmers_output + num_blocks*(i+1) - 1 - b, p + b * sizeof(uint64_t), sizeof(uint64_t));
+      }
+    }
+  }
+}
+
+static void advise_huge_pages(void * p, size_t len) {
+  #ifdef MADV_HUGEPAGE
+  // madvise needs a page aligned start, so only advise the pages fully inside the range
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  uintptr_t start  = ((uintptr_t)p + page_size - 1) & ~(page_size - 1);
+  uintptr_t end    = ((uintptr_t)p + len) & ~(page_size - 1);
+  if (start < end) madvise((void*)start, end - start, MADV_HUGEPAGE);
+  #else
+  (void)p; (void)len;
+  #endif
+}
+
+// Expects handle to be positioned at the first record (i.e. after dsk_read_header).
+size_t dsk_read_kmers_mmap(int handle, uint32_t kmer_num_bits, uint64_t * kmers_output, size_t num_threads) {
+  assert(kmer_num_bits <= MAX_BITS_PER_KMER);
+  struct stat st;
+  off_t header_size = lseek(handle, 0, SEEK_CUR);
+  if (header_size == -1 || fstat(handle, &st) == -1) return 0;
+
+  size_t record_size = DSK_FILE_RECORD_SIZE(kmer_num_bits);
+  size_t num_records = (st.st_size - header_size)/record_size;
+  if (num_records == 0) return 0;
+
+  // mmap offsets have to be page aligned, so map the header too and skip it
+  void * mapped = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
+  if (mapped == MAP_FAILED) return 0;
+  madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+  madvise(mapped, st.st_size, MADV_WILLNEED);
+  advise_huge_pages(mapped, st.st_size);
+  size_t kmer_num_blocks = (kmer_num_bits/8)/sizeof(uint64_t);
+  advise_huge_pages(kmers_output, num_records * kmer_num_blocks * sizeof(uint64_t));
+
+  const char * records = (const char*)mapped + header_size;
+  if (num_threads < 1) num_threads = 1;
+  size_t chunk_size = (num_records + num_threads - 1)/num_threads;
+  vector<thread> workers;
+  for (size_t t = 0; t < num_threads; t++) {
+    size_t lo = std::min(t * chunk_size, num_records);
+    size_t hi = std::min(lo + chunk_size, num_records);
+    workers.push_back(thread(dsk_extract_kmers, records, kmer_num_bits, kmers_output, lo, hi));
+  }
+  for (auto & w : workers) w.join();
+
+  munmap(mapped, st.st_size);
+  return num_records;
+}
@@ -3,18 +3,24 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <stdlib.h>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <tuple>
+#include <thread>
+#include <algorithm>
+#include <memory>
 
 #include "dummies.hpp"
 #include "kmer.hpp"
 #include "debug.h"
 
-static const size_t MAX_BITS_PER_KMER = 128;
+static const size_t MAX_BITS_PER_KMER = 256; // k <= 128, as a uint256_t (see wide_uint.hpp)
 static const size_t BUFFER_SIZE = 0x8000; // 32Kb data buffer
 
 using namespace std;
@@ -25,8 +31,10 @@ using namespace std;
 int dsk_read_header(int, uint32_t *, uint32_t *);
 // Counts the number of records in the file - for allocation purposes
 int dsk_num_records(int handle, uint32_t kmer_num_bits, size_t * num_records);
-// Read kmers from file into the output array
-size_t dsk_read_kmers(int handle, uint32_t kmer_num_bits, uint64_t * kmers_output);
+// Read kmers from file into the output array (at most max_records of them, if given)
+size_t dsk_read_kmers(int handle, uint32_t kmer_num_bits, uint64_t * kmers_output, size_t max_records = 0);
+// Same as above, but maps the file into memory and extracts the kmers with several threads
+size_t dsk_read_kmers_mmap(int handle, uint32_t kmer_num_bits, uint64_t * kmers_output, size_t num_threads = 1);
 //void merge_and_output(FILE * outfile, uint64_t * table_a, uint64_t * table_b, uint64_t * incoming_dummies, size_t num_records, size_t num_incoming_dummies, uint32_t k);
 
 typedef uint8_t packed_edge;
@@ -120,6 +128,102 @@ inline packed_edge get_packed_edge(BlockIterator blocks, size_t i) {
   return get_packed_edge_from_block(blocks[block_idx], local_idx);
 }
 
+// Sorted runs of kmers for external merging (raw kmer_t arrays)
+template <typename kmer_t>
+bool write_kmer_run(const string & filename, const kmer_t * kmers, size_t num_kmers) {
+  FILE * f = fopen(filename.c_str(), "wb");
+  if (!f) return false;
+  bool ok = fwrite(kmers, sizeof(kmer_t), num_kmers, f) == num_kmers;
+  return (fclose(f) == 0) && ok;
+}
+
+template <typename kmer_t>
+class kmer_run_reader {
+  FILE * _f = 0;
+  vector<kmer_t> _buf;
+  size_t _pos = 0;
+  size_t _len = 0;
+
+  public:
+  kmer_run_reader(const string & filename, size_t buffer_len) : _buf(buffer_len) {
+    _f = fopen(filename.c_str(), "rb");
+    if (!_f) {
+      cerr << "Error opening temporary file " << filename << endl;
+      exit(1);
+    }
+  }
+
+  // owns _f
+  kmer_run_reader(const kmer_run_reader &) = delete;
+  kmer_run_reader & operator=(const kmer_run_reader &) = delete;
+
+  ~kmer_run_reader() {
+    if (_f) fclose(_f);
+  }
+
+  bool next(kmer_t & x) {
+    if (_pos == _len) {
+      _len = fread(&_buf[0], sizeof(kmer_t), _buf.size(), _f);
+      _pos = 0;
+      if (_len == 0) return false;
+    }
+    x = _buf[_pos++];
+    return true;
+  }
+};
+
+// k-way merge of sorted runs. Can only be indexed in increasing order (like a stream), which is all that
+// the dummy edge merging needs. Positions past the end return kmer_t().
+template <typename kmer_t, class Compare>
+class merged_kmer_runs {
+  typedef pair<kmer_t, size_t> head_t; // current kmer of a run, run index
+  vector<unique_ptr<kmer_run_reader<kmer_t>>> _runs;
+  Compare _less;
+  // min-heap on the kmers
+  struct head_greater {
+    Compare _less;
+    head_greater(Compare less) : _less(less) {}
+    bool operator()(const head_t & x, const head_t & y) const { return _less(y.first, x.first); }
+  };
+  vector<head_t> _heap;
+  head_greater _greater;
+  size_t  _idx = 0;
+  kmer_t  _current;
+
+  void _pop() {
+    if (_heap.empty()) {
+      _current = kmer_t();
+      return;
+    }
+    pop_heap(_heap.begin(), _heap.end(), _greater);
+    head_t & head = _heap.back();
+    _current = head.first;
+    if (_runs[head.second]->next(head.first)) push_heap(_heap.begin(), _heap.end(), _greater);
+    else _heap.pop_back();
+  }
+
+  public:
+  merged_kmer_runs(const vector<string> & filenames, Compare less, size_t buffer_len) : _less(less), _greater(less) {
+    for (size_t i = 0; i < filenames.size(); i++) {
+      _runs.push_back(unique_ptr<kmer_run_reader<kmer_t>>(new kmer_run_reader<kmer_t>(filenames[i], buffer_len)));
+      kmer_t x;
+      if (_runs[i]->next(x)) _heap.push_back(head_t(x, i));
+    }
+    make_heap(_heap.begin(), _heap.end(), _greater);
+    _pop();
+  }
+
+  // the readers own open files, so a copy would share them
+  merged_kmer_runs(const merged_kmer_runs &) = delete;
+  merged_kmer_runs & operator=(const merged_kmer_runs &) = delete;
+
+  kmer_t operator[](size_t i) {
+    assert(i >= _idx);
+    for (; _idx < i; _idx++) _pop();
+    return _current;
+  }
+};
+
 typedef std::tuple<uint8_t, bool, bool> edge_tuple;
 
 static inline uint8_t unpack_symbol(packed_edge x) { return x >> 2; }
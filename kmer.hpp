@@ -10,6 +10,7 @@
 #include "debug.h"
 #include "lut.hpp"
 #include "uint128_t.hpp"
+#include "wide_uint.hpp"
 
 #define BLOCK_WIDTH 64
 #define NT_WIDTH 2
@@ -17,12 +18,18 @@
 #define DNA_ALPHA "acgt"
 #define DUMMY_SYM '$'
 
+// k as a compile time constant. The functions below that take k have its type as a template parameter, so passing
+// a static_k<K> (rather than a uint32_t) makes their shifts and masks constants (see convert_static_k in pack.hpp).
+template <uint32_t K>
+struct static_k {
+  static const uint32_t value = K;
+  constexpr operator uint32_t() const { return K; }
+};
+
 // Swaps G (11 -> 10) and T (10 -> 11) representation so radix ordering is lexical
 // (needed because some kmer counters like DSK swap this representation, but we assume G < T
 // in our de bruijn graph implementation)
 
-// TODO: Could probably make this faster using a static k param
-
 static struct swap_gt_f : std::unary_function<uint64_t, uint64_t> {
   inline uint64_t operator() (const uint64_t & x) const { return (x ^ ((x & 0xAAAAAAAAAAAAAAAA) >> 1)); }
 } swap_gt;
@@ -41,6 +48,42 @@ inline uint8_t get_nt(const uint128_t & block, uint8_t i) {
   return get_nt(block_64, i%nts_per_block);
 }
 
+template <size_t num_blocks>
+inline uint8_t get_nt(const wide_uint<num_blocks> & block, uint8_t i) {
+  const uint8_t nts_per_block = BLOCK_WIDTH/NT_WIDTH;
+  return get_nt(block._blocks[i/nts_per_block], i%nts_per_block);
+}
+
+// Returns nts [i, i+w) as one number (nt i being the most significant), so several nts can be
+// radix sorted per pass. Assumes 0 < w and w nts fit in 64 bits.
+inline uint64_t get_nts(uint64_t block, uint8_t i, uint8_t w) {
+  return (block << (i * NT_WIDTH)) >> (BLOCK_WIDTH - w * NT_WIDTH);
+}
+
+inline uint64_t get_nts(const uint128_t & block, uint8_t i, uint8_t w) {
+  const uint8_t nts_per_block = BLOCK_WIDTH/NT_WIDTH;
+  const uint64_t * blocks = (const uint64_t*)(&block);
+  uint8_t block_idx = i/nts_per_block;
+  uint8_t local_idx = i%nts_per_block;
+  if (local_idx + w <= nts_per_block) return get_nts(blocks[block_idx], local_idx, w);
+  // Straddles both blocks
+  uint8_t upper_w = nts_per_block - local_idx;
+  return (get_nts(blocks[block_idx], local_idx, upper_w) << ((w - upper_w) * NT_WIDTH)) |
+          get_nts(blocks[block_idx + 1], 0, w - upper_w);
+}
+
+template <size_t num_blocks>
+inline uint64_t get_nts(const wide_uint<num_blocks> & block, uint8_t i, uint8_t w) {
+  const uint8_t nts_per_block = BLOCK_WIDTH/NT_WIDTH;
+  uint8_t block_idx = i/nts_per_block;
+  uint8_t local_idx = i%nts_per_block;
+  if (local_idx + w <= nts_per_block) return get_nts(block._blocks[block_idx], local_idx, w);
+  // Straddles two blocks
+  uint8_t upper_w = nts_per_block - local_idx;
+  return (get_nts(block._blocks[block_idx], local_idx, upper_w) << ((w - upper_w) * NT_WIDTH)) |
+          get_nts(block._blocks[block_idx + 1], 0, w - upper_w);
+}
+
 template <typename kmer_t>
 kmer_t clear_nt(const kmer_t & x, uint8_t i) {
   // Keep in mind that 0 is the leftmost nt, but that the leftmost is the edge (so rightmost in our diagrams)
@@ -63,6 +106,13 @@ struct get_nt_functor : std::binary_function<T, uint8_t, uint8_t> {
   }
 };
 
+template <typename T>
+struct get_nts_functor {
+  uint64_t operator() (const T & x, uint8_t i, uint8_t w) {
+    return get_nts(x, i, w);
+  }
+};
+
 template <typename T>
 uint8_t get_edge_label(const T & x) {
   return get_nt(x, 0);
@@ -74,7 +124,7 @@ uint8_t get_edge_label(const T & x) {
 template <typename T>
 T get_range(const T & x, uint8_t lo, uint8_t hi) {
   const size_t NUM_NTS = bitwidth<T>::width/NT_WIDTH;
-  uint8_t shift = (hi < NUM_NTS)? (NUM_NTS - hi) * NT_WIDTH : 0;
+  size_t shift = (hi < NUM_NTS)? (NUM_NTS - hi) * NT_WIDTH : 0;
   return (x >> shift) << (shift + lo * NT_WIDTH);
 }
 
@@ -92,16 +142,36 @@ T get_start_node(const T & x) {
   //return get_range(x, 1, k);
 }
 
-template <typename T>
-T get_start_node_suffix(const T & x, uint8_t k) {
+template <typename T, typename t_k>
+T get_start_node_suffix(const T & x, t_k k) {
   return get_range(x, 1, k-1);
 }
 
-template <typename T>
-T get_end_node(const T & x, uint8_t k) {
+template <typename T, typename t_k>
+T get_end_node(const T & x, t_k k) {
   return get_range(x, 0, k-1);
 }
 
+// <colex(node), edge> order (i.e. the order of table A in cosmo-pack)
+template <typename T>
+bool node_edge_less(const T & x, const T & y) {
+  T x_node = get_start_node(x);
+  T y_node = get_start_node(y);
+  return x_node < y_node || (x_node == y_node && get_edge_label(x) < get_edge_label(y));
+}
+
+// Moves the edge label (nt 0) to the end (nt k-1), so that sorting the results as integers
+// gives <colex(node), edge> order without needing a stable sort. node_edge_from_sortable undoes it.
+template <typename T, typename t_k>
+T node_edge_to_sortable(const T & x, t_k k) {
+  return set_nt(get_start_node(x), k-1, get_edge_label(x));
+}
+
+template <typename T, typename t_k>
+T node_edge_from_sortable(const T & x, t_k k) {
+  return set_nt(clear_nt(x, k-1) >> NT_WIDTH, 0, get_nt(x, k-1));
+}
+
 // Doesn't reverse on bit level, reverses at the two-bit level
 inline uint64_t reverse_block(uint64_t x) {
   uint64_t output;
@@ -131,6 +201,15 @@ struct reverse_nt<uint128_t> : std::unary_function<uint128_t, uint128_t> {
   }
 };
 
+template <size_t num_blocks>
+struct reverse_nt<wide_uint<num_blocks>> : std::unary_function<wide_uint<num_blocks>, wide_uint<num_blocks>> {
+  inline wide_uint<num_blocks> operator() (const wide_uint<num_blocks> & x) const {
+    wide_uint<num_blocks> result;
+    for (size_t b = 0; b < num_blocks; b++) result._blocks[b] = reverse_block(x._blocks[num_blocks - 1 - b]);
+    return result;
+  }
+};
+
 inline static uint64_t revcomp_block(uint64_t x) {
   uint64_t output;
 
@@ -147,32 +226,43 @@ inline static uint64_t revcomp_block(uint64_t x) {
   return output;
 }
 
-template <class T>
+template <class T, class t_k = uint8_t>
 struct reverse_complement : std::unary_function<T, T> {
-  const uint8_t _k;
-  reverse_complement(uint8_t k) : _k(k) {}
+  const t_k _k;
+  reverse_complement(t_k k) : _k(k) {}
   T operator() (const T& x) const {
     return revcomp_block((uint64_t)x) << (64 - _k * NT_WIDTH);
   }
 };
 
-template <>
-struct reverse_complement<uint128_t> : std::unary_function<uint128_t, uint128_t> {
-  const uint8_t _k;
-  reverse_complement(uint8_t k) : _k(k) {}
+template <class t_k>
+struct reverse_complement<uint128_t, t_k> : std::unary_function<uint128_t, uint128_t> {
+  const t_k _k;
+  reverse_complement(t_k k) : _k(k) {}
   uint128_t operator() (const uint128_t & x) const {
     return uint128_t(revcomp_block(x._lower), revcomp_block(x._upper)) << (128 - _k * NT_WIDTH);
   }
 };
 
-template <typename kmer_t>
-bool is_palindrome(const kmer_t & x, uint8_t k) {
-  return (k%2==0 && x == reverse_complement<kmer_t>(k)(x));
+template <size_t num_blocks, class t_k>
+struct reverse_complement<wide_uint<num_blocks>, t_k> : std::unary_function<wide_uint<num_blocks>, wide_uint<num_blocks>> {
+  const t_k _k;
+  reverse_complement(t_k k) : _k(k) {}
+  wide_uint<num_blocks> operator() (const wide_uint<num_blocks> & x) const {
+    wide_uint<num_blocks> result;
+    for (size_t b = 0; b < num_blocks; b++) result._blocks[b] = revcomp_block(x._blocks[num_blocks - 1 - b]);
+    return result << (bitwidth<wide_uint<num_blocks>>::width - _k * NT_WIDTH);
+  }
+};
+
+template <typename kmer_t, typename t_k>
+bool is_palindrome(const kmer_t & x, t_k k) {
+  return (k%2==0 && x == reverse_complement<kmer_t, t_k>(k)(x));
 }
 
-template <typename kmer_t>
-kmer_t representative(const kmer_t & x, uint8_t k) {
-  kmer_t twin = reverse_complement<kmer_t>(k)(x);
+template <typename kmer_t, typename t_k>
+kmer_t representative(const kmer_t & x, t_k k) {
+  kmer_t twin = reverse_complement<kmer_t, t_k>(k)(x);
   return (x < twin)? x : twin;
 }
 
@@ -208,7 +298,7 @@ void convert_representation(const kmer_t * kmers_in, kmer_t * kmers_out, size_t
   // Swap G and T and reverses the nucleotides so that they can
   // be compared and sorted as integers to give colexicographical ordering
   std::transform((uint64_t*)kmers_in, (uint64_t*)(kmers_in + num_kmers), (uint64_t*)kmers_out, swap_gt);
-  std::transform(kmers_in, kmers_in + num_kmers, kmers_out, reverse_nt<kmer_t>());
+  std::transform(kmers_out, kmers_out + num_kmers, kmers_out, reverse_nt<kmer_t>());
 }
 
 // Convenience function to print array of kmers
@@ -220,8 +310,8 @@ void print_kmers(std::ostream & out, kmer_t * kmers, size_t num_kmers, uint32_t
 }
 
 // Longest common suffix
-template <typename kmer_t>
-size_t lcs(const kmer_t & a, const kmer_t & b, size_t k) {
+template <typename kmer_t, typename t_k>
+size_t lcs(const kmer_t & a, const kmer_t & b, t_k k) {
   static const size_t num_blocks = bitwidth<kmer_t>::width/BLOCK_WIDTH;
   //kmer_t x = a ^ b; // Do this in the loop below instead to potentially save some cycles
   uint64_t * p = (uint64_t*)&a;
@@ -240,11 +330,11 @@ size_t lcs(const kmer_t & a, const kmer_t & b, size_t k) {
     }
   }
   total /= NT_WIDTH;
-  return std::min(total, k);
+  return std::min(total, (size_t)k);
 }
 
-template <typename kmer_t>
-size_t node_lcs(const kmer_t & a, const kmer_t & b, size_t k) {
+template <typename kmer_t, typename t_k>
+size_t node_lcs(const kmer_t & a, const kmer_t & b, t_k k) {
   //assert(k>0); // Shouldnt be called this way, but we also minus 1 down below...
   if (k == 0) return 0;
   kmer_t x(a);
@@ -0,0 +1,96 @@
+#pragma once
+#ifndef _KMER_INDEX_HPP
+#define _KMER_INDEX_HPP
+
+#include <vector>
+#include <string>
+
+#include "debruijn_graph.hpp"
+
+using namespace std;
+
+// Lookup table over a debruijn_graph that stores the node range of every ACGT string of length m (4^m ranges,
+// 16 bytes each), so find_node can skip the first m extension steps. Labels that start with $ fall back to the graph.
+template <class t_graph = debruijn_graph<>>
+class kmer_index {
+  public:
+  typedef typename t_graph::node_type   node_type;
+  typedef typename t_graph::label_type  label_type;
+  typedef typename t_graph::symbol_type symbol_type;
+
+  private:
+  const t_graph &   m_graph;
+  size_t            m_prefix_len;
+  vector<node_type> m_ranges; // indexed by the prefix as a base 4 number (first symbol most significant)
+
+  void _fill(size_t code, size_t len, const node_type & range) {
+    if (len == m_prefix_len) {
+      m_ranges[code] = range;
+      return;
+    }
+    for (symbol_type x = 1; x <= t_graph::sigma; x++) {
+      _fill(code * t_graph::sigma + x - 1, len + 1, m_graph._extend_range(range, x));
+    }
+  }
+
+  // Range of label's first m symbols from the table, or the graph's own start if the table can't be used
+  node_type _start(const label_type & label, size_t & pos) const {
+    if (m_prefix_len > 0 && label.size() >= m_prefix_len) {
+      size_t code = 0;
+      for (pos = 0; pos < m_prefix_len; pos++) {
+        symbol_type x = m_graph._unmap_symbol(label[pos]);
+        if (x == 0 || x > t_graph::sigma) break;
+        code = code * t_graph::sigma + x - 1;
+      }
+      if (pos == m_prefix_len) return m_ranges[code];
+    }
+    return m_graph._label_start(label, pos);
+  }
+
+  public:
+  // prefix_len is capped at k-1
+  kmer_index(const t_graph & g, size_t prefix_len = 8) : m_graph(g), m_prefix_len(std::min(prefix_len, g.k-1)) {
+    size_t num_prefixes = 1;
+    for (size_t i = 0; i < m_prefix_len; i++) num_prefixes *= t_graph::sigma;
+    m_ranges.resize(num_prefixes);
+    if (m_prefix_len == 0) return;
+    for (symbol_type x = 1; x <= t_graph::sigma; x++) {
+      label_type first(1, m_graph._map_symbol(x));
+      size_t pos;
+      _fill(x - 1, 1, m_graph._label_start(first, pos));
+    }
+  }
+
+  size_t prefix_len() const { return m_prefix_len; }
+  size_t size_in_bytes() const { return m_ranges.size() * sizeof(node_type); }
+
+  // Same as debruijn_graph::find_node
+  ssize_t find_node(const label_type & label) const {
+    size_t pos = 0;
+    node_type range = _start(label, pos);
+    return m_graph._find_node_from(label, range, pos);
+  }
+
+  // Same as debruijn_graph::find_edge
+  ssize_t find_edge(const label_type & label) const {
+    if (label.size() != m_graph.k) return -1;
+    ssize_t v = find_node(label.substr(0, m_graph.k-1));
+    symbol_type x = m_graph._unmap_symbol(label[m_graph.k-1]);
+    if (v == -1 || x > t_graph::sigma) return -1;
+    auto range = m_graph._node_range(v);
+    return m_graph._last_edge_labelled(get<0>(range), get<1>(range), x);
+  }
+
+  bool contains(const label_type & kmer) const { return find_edge(kmer) != -1; }
+
+  // Same as debruijn_graph::find_nodes
+  void find_nodes(const label_type * labels, size_t n, ssize_t * out) const {
+    if (n == 0) return;
+    vector<node_type> starts(n);
+    vector<size_t> from(n);
+    for (size_t q = 0; q < n; q++) starts[q] = _start(labels[q], from[q]);
+    m_graph._find_nodes_from(labels, n, &starts[0], &from[0], out);
+  }
+};
+
+#endif
@@ -0,0 +1,212 @@
+#pragma once
+#ifndef KMER_KERNELS_HPP
+#define KMER_KERNELS_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include "uint128_t.hpp"
+#include "wide_uint.hpp"
+#include "kmer.hpp"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#define KMER_KERNELS_X86
+#endif
+
+// Fused versions of convert_representation (and of reverse_complement over the converted kmers) in kmer.hpp, which
+// take a single pass over the kmers instead of up to three, and don't use the byte lookup tables of lut.hpp.
+// Reversing the nts and complementing commute, so the reverse complement of a converted kmer is just the complement
+// of the kmer with G and T swapped (shifted up to the top of the block), and needs no reversal of its own.
+// The SSSE3 and AVX2 versions convert each nibble of 16 (or 32) bytes at a time with pshufb, and then reverse the
+// bytes of each kmer with another one. The best version the CPU supports is picked at runtime.
+
+enum kernel_isa { isa_scalar, isa_ssse3, isa_avx2 };
+
+inline const char * kernel_isa_name(kernel_isa isa) {
+  switch (isa) {
+    case isa_avx2:  return "avx2";
+    case isa_ssse3: return "ssse3";
+    default:        return "scalar";
+  }
+}
+
+inline kernel_isa best_kernel_isa() {
+  #ifdef KMER_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return isa_avx2;
+  if (__builtin_cpu_supports("ssse3")) return isa_ssse3;
+  #endif
+  return isa_scalar;
+}
+
+// The SIMD versions only take 64 and 128 bit kmers, so wider ones (wide_uint) are converted by the scalar version
+template <typename kmer_t>
+kernel_isa best_kernel_isa_for() {
+  return (sizeof(kmer_t) > 2 * sizeof(uint64_t))? isa_scalar : best_kernel_isa();
+}
+
+inline uint64_t _swap_gt_block(uint64_t x) {
+  return x ^ ((x & 0xAAAAAAAAAAAAAAAA) >> 1);
+}
+
+// Same as reverse_block, with shifts instead of lookups
+inline uint64_t _reverse_nts_block(uint64_t x) {
+  x = __builtin_bswap64(x);
+  x = ((x >> 4) & 0x0F0F0F0F0F0F0F0F) | ((x & 0x0F0F0F0F0F0F0F0F) << 4);
+  return ((x >> 2) & 0x3333333333333333) | ((x & 0x3333333333333333) << 2);
+}
+
+inline uint64_t _convert_kmer(uint64_t x) {
+  return _reverse_nts_block(_swap_gt_block(x));
+}
+
+inline uint128_t _convert_kmer(const uint128_t & x) {
+  return uint128_t(_reverse_nts_block(_swap_gt_block(x._lower)), _reverse_nts_block(_swap_gt_block(x._upper)));
+}
+
+template <size_t num_blocks>
+inline wide_uint<num_blocks> _convert_kmer(const wide_uint<num_blocks> & x) {
+  wide_uint<num_blocks> result;
+  for (size_t b = 0; b < num_blocks; b++) result._blocks[b] = _convert_kmer(x._blocks[num_blocks - 1 - b]);
+  return result;
+}
+
+// Reverse complement of _convert_kmer(x), where shift is the width of the block minus that of the kmer
+inline uint64_t _revcomp_kmer(uint64_t x, uint32_t shift) {
+  return ~_swap_gt_block(x) << shift;
+}
+
+inline uint128_t _revcomp_kmer(const uint128_t & x, uint32_t shift) {
+  return uint128_t(~_swap_gt_block(x._upper), ~_swap_gt_block(x._lower)) << shift;
+}
+
+template <size_t num_blocks>
+inline wide_uint<num_blocks> _revcomp_kmer(const wide_uint<num_blocks> & x, uint32_t shift) {
+  wide_uint<num_blocks> result;
+  for (size_t b = 0; b < num_blocks; b++) result._blocks[b] = ~_swap_gt_block(x._blocks[b]);
+  return result << shift;
+}
+
+#ifdef KMER_KERNELS_X86
+// _convert_kmer of each nibble (for a nibble xy, the converted y then x), looked up with pshufb. Each byte then
+// gets its converted low nibble as its high nibble and vice versa.
+#define _CONVERTED_NIBBLES 0x0, 0x4, 0xC, 0x8, 0x1, 0x5, 0xD, 0x9, 0x3, 0x7, 0xF, 0xB, 0x2, 0x6, 0xE, 0xA
+// Byte order after reversing each kmer: each 8 bytes for 64 bit kmers, all 16 for 128 bit ones
+#define _REVERSED_BYTES_64  7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+#define _REVERSED_BYTES_128 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+
+// Shift counts of the reverse complements for _convert_words_*: for 128 bit kmers, a shift by c is
+// (x << c) | ((x >> 64) >> (64-c)) | ((x >> 64) << (c-64)) on each 64 bit lane, where a count of 64 gives 0
+struct _revcomp_shifts {
+  uint64_t lane, from_lower, to_upper;
+  _revcomp_shifts(uint32_t shift, bool wide) : lane(shift), from_lower(64), to_upper(64) {
+    if (!wide) return;
+    if (shift < 64) from_lower = (shift == 0)? 64 : 64 - shift;
+    else to_upper = shift - 64;
+  }
+};
+
+// Converts the 64 bit words in [0, num_words) 2 at a time (and their reverse complements if revcomps isn't null),
+// and returns how many it did. The rest are left to the scalar version.
+template <bool wide>
+__attribute__((target("ssse3")))
+size_t _convert_words_ssse3(const uint64_t * in, uint64_t * out, uint64_t * revcomps, size_t num_words,
+                            _revcomp_shifts shifts) {
+  const __m128i nibbles   = _mm_set1_epi8(0x0F);
+  const __m128i high_bits = _mm_set1_epi8((char)0xAA);
+  const __m128i lo_table  = _mm_setr_epi8(_CONVERTED_NIBBLES);
+  const __m128i hi_table  = _mm_slli_epi16(lo_table, 4);
+  const __m128i order     = (wide)? _mm_setr_epi8(_REVERSED_BYTES_128) : _mm_setr_epi8(_REVERSED_BYTES_64);
+  const __m128i lane      = _mm_cvtsi64_si128(shifts.lane);
+  const __m128i from_lower = _mm_cvtsi64_si128(shifts.from_lower);
+  const __m128i to_upper  = _mm_cvtsi64_si128(shifts.to_upper);
+  size_t i = 0;
+  for (; i + 2 <= num_words; i += 2) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+    if (revcomps) {
+      __m128i s  = _mm_xor_si128(x, _mm_srli_epi64(_mm_and_si128(x, high_bits), 1));
+      __m128i c  = _mm_xor_si128(s, _mm_cmpeq_epi8(s, s));
+      __m128i rc = _mm_sll_epi64(c, lane);
+      if (wide) {
+        __m128i lower = _mm_unpackhi_epi64(c, _mm_setzero_si128());
+        rc = _mm_or_si128(rc, _mm_or_si128(_mm_srl_epi64(lower, from_lower), _mm_sll_epi64(lower, to_upper)));
+      }
+      _mm_storeu_si128((__m128i*)(revcomps + i), rc);
+    }
+    __m128i y = _mm_or_si128(_mm_shuffle_epi8(hi_table, _mm_and_si128(x, nibbles)),
+                             _mm_shuffle_epi8(lo_table, _mm_and_si128(_mm_srli_epi16(x, 4), nibbles)));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_shuffle_epi8(y, order));
+  }
+  return i;
+}
+
+// Same as above, 4 words at a time (pshufb and unpackhi work within each 128 bit lane, which holds whole kmers)
+template <bool wide>
+__attribute__((target("avx2")))
+size_t _convert_words_avx2(const uint64_t * in, uint64_t * out, uint64_t * revcomps, size_t num_words,
+                           _revcomp_shifts shifts) {
+  const __m256i nibbles   = _mm256_set1_epi8(0x0F);
+  const __m256i high_bits = _mm256_set1_epi8((char)0xAA);
+  const __m256i lo_table  = _mm256_broadcastsi128_si256(_mm_setr_epi8(_CONVERTED_NIBBLES));
+  const __m256i hi_table  = _mm256_slli_epi16(lo_table, 4);
+  const __m256i order     = _mm256_broadcastsi128_si256((wide)? _mm_setr_epi8(_REVERSED_BYTES_128) :
+                                                                _mm_setr_epi8(_REVERSED_BYTES_64));
+  const __m128i lane      = _mm_cvtsi64_si128(shifts.lane);
+  const __m128i from_lower = _mm_cvtsi64_si128(shifts.from_lower);
+  const __m128i to_upper  = _mm_cvtsi64_si128(shifts.to_upper);
+  size_t i = 0;
+  for (; i + 4 <= num_words; i += 4) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(in + i));
+    if (revcomps) {
+      __m256i s  = _mm256_xor_si256(x, _mm256_srli_epi64(_mm256_and_si256(x, high_bits), 1));
+      __m256i c  = _mm256_xor_si256(s, _mm256_cmpeq_epi8(s, s));
+      __m256i rc = _mm256_sll_epi64(c, lane);
+      if (wide) {
+        __m256i lower = _mm256_unpackhi_epi64(c, _mm256_setzero_si256());
+        rc = _mm256_or_si256(rc, _mm256_or_si256(_mm256_srl_epi64(lower, from_lower), _mm256_sll_epi64(lower, to_upper)));
+      }
+      _mm256_storeu_si256((__m256i*)(revcomps + i), rc);
+    }
+    __m256i y = _mm256_or_si256(_mm256_shuffle_epi8(hi_table, _mm256_and_si256(x, nibbles)),
+                                _mm256_shuffle_epi8(lo_table, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibbles)));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_shuffle_epi8(y, order));
+  }
+  return i;
+}
+#endif
+
+// Converts num_kmers kmers (as read from DSK) from in to out (which can be the same array) like convert_representation,
+// and if revcomps isn't null, writes the reverse complements of the converted kmers to it (as reverse_complement does).
+template <typename kmer_t, typename t_k>
+void convert_kmers(const kmer_t * in, kmer_t * out, size_t num_kmers, kmer_t * revcomps, const t_k k,
+                   kernel_isa isa = best_kernel_isa_for<kmer_t>()) {
+  const uint32_t shift = bitwidth<kmer_t>::width - k * NT_WIDTH;
+  size_t i = 0;
+  #ifdef KMER_KERNELS_X86
+  const size_t words_per_kmer = sizeof(kmer_t) / sizeof(uint64_t);
+  const bool wide = words_per_kmer == 2;
+  _revcomp_shifts shifts(shift, wide);
+  size_t num_words = num_kmers * words_per_kmer;
+  size_t done = 0;
+  if (words_per_kmer > 2) isa = isa_scalar;
+  if (isa == isa_avx2) {
+    done = (wide)? _convert_words_avx2<true>((const uint64_t*)in, (uint64_t*)out, (uint64_t*)revcomps, num_words, shifts) :
+                   _convert_words_avx2<false>((const uint64_t*)in, (uint64_t*)out, (uint64_t*)revcomps, num_words, shifts);
+  }
+  else if (isa == isa_ssse3) {
+    done = (wide)? _convert_words_ssse3<true>((const uint64_t*)in, (uint64_t*)out, (uint64_t*)revcomps, num_words, shifts) :
+                   _convert_words_ssse3<false>((const uint64_t*)in, (uint64_t*)out, (uint64_t*)revcomps, num_words, shifts);
+  }
+  i = done / words_per_kmer;
+  #else
+  (void)isa;
+  #endif
+  for (; i < num_kmers; i++) {
+    kmer_t x = in[i];
+    if (revcomps) revcomps[i] = _revcomp_kmer(x, shift);
+    out[i] = _convert_kmer(x);
+  }
+}
+
+#endif
@@ -0,0 +1,224 @@
+#pragma once
+#ifndef _LCS_VECTOR_HPP
+#define _LCS_VECTOR_HPP
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+
+#include <sdsl/int_vector.hpp>
+#include <sdsl/rmq_support.hpp>
+
+#include "wt_algorithm.hpp"
+
+using namespace std;
+using namespace sdsl;
+
+// Remaps LCS values as they are produced (as quantize.py did to the .lcs file): with levels, each value becomes the
+// largest level <= it (or 0), and with a threshold, the values below it become 0. Fewer distinct values make the LCS
+// structures smaller, at the cost of shorter only reaching the context lengths that are left.
+class lcs_quantizer {
+  public:
+  static const size_t max_lcs = 256; // LCS values are < k, and fit the byte cosmo-pack writes them in
+
+  private:
+  array<uint8_t, max_lcs> m_map;
+
+  public:
+  // No levels and no threshold keeps the values as they are
+  lcs_quantizer(vector<size_t> levels = vector<size_t>(), size_t threshold = 0) {
+    std::sort(levels.begin(), levels.end());
+    for (size_t x = 0; x < max_lcs; x++) {
+      if (!levels.empty()) {
+        auto next = std::upper_bound(levels.begin(), levels.end(), x);
+        m_map[x] = (next == levels.begin())? 0 : std::min(*(next-1), max_lcs-1);
+      }
+      else m_map[x] = (x < threshold)? 0 : x;
+    }
+  }
+
+  size_t operator()(size_t x) const { return m_map[std::min(x, max_lcs-1)]; }
+
+  // bits needed for the remapped values of a graph of order k
+  uint8_t width(size_t k) const {
+    size_t max_value = 1;
+    for (size_t x = 0; x < std::min(k, max_lcs); x++) max_value = std::max(max_value, (size_t)m_map[x]);
+    return bits::hi(max_value) + 1;
+  }
+};
+
+// Reads the one byte LCS values cosmo-pack writes to [output].packed.lcs, remapping them while they are read (so no
+// byte per edge copy is kept)
+inline int_vector<> load_lcs_from_file(const string & filename, size_t k, const lcs_quantizer & quantize) {
+  ifstream in(filename, ios::in | ios::binary | ios::ate);
+  if (!in) throw runtime_error("Can't open " + filename);
+  streampos size = in.tellg();
+  if (size < 0) throw runtime_error("Can't read the size of " + filename);
+  int_vector<> values(size, 0, quantize.width(k));
+  in.seekg(0, ios::beg);
+  const size_t buffer_len = 1 << 16;
+  vector<char> buffer(buffer_len);
+  for (size_t i = 0; i < values.size();) {
+    size_t len = std::min(buffer_len, values.size() - i);
+    if (!in.read(buffer.data(), len) || (size_t)in.gcount() != len) {
+      throw runtime_error("Error reading " + filename + " (" + to_string(i + in.gcount()) + " of " +
+                          to_string(values.size()) + " LCS values)");
+    }
+    for (size_t j = 0; j < len; j++) values[i++] = quantize((uint8_t)buffer[j]);
+  }
+  return values;
+}
+
+// Alternative to the LCS wavelet tree of a debruijn_hypergraph (t_lcs_vector). shorter and longer only ask for the
+// previous/next position holding a value <= c, which is a previous/next smaller value query: the values are kept
+// as they are (a few bits each, since they are < k), with a succinct RMQ over them. A query scans the scan_len values
+// next to the position (where most answers are), then searches outward in windows of doubling width until the RMQ of
+// one is <= c, and finishes with a binary search of RMQs inside it. So it takes O(log distance) RMQs instead of a
+// descent of the wavelet tree, and prev_lte etc. answer the same as the wt_int versions in wt_algorithm.hpp.
+class rmq_lcs_vector {
+  public:
+  typedef uint64_t size_type;
+  typedef uint64_t value_type;
+
+  static const size_t scan_len = 32;
+
+  private:
+  int_vector<>        m_values;
+  rmq_succinct_sct<>  m_rmq;
+  value_type          m_min = ~0ULL; // if c is below it nothing is <= c, and the queries return 0 (as the WT ones do)
+
+  // last position in [a, b] with a value <= c, given that m_values[a] is one
+  size_t _last_lte(size_t a, size_t b, value_type c) const {
+    while (a < b) {
+      size_t mid = a + (b - a + 1)/2;
+      size_t m = m_rmq(mid, b);
+      if (m_values[m] <= c) a = m;
+      else b = mid - 1;
+    }
+    return a;
+  }
+
+  // first position in [a, b] with a value <= c, given that m_values[b] is one
+  size_t _first_lte(size_t a, size_t b, value_type c) const {
+    while (a < b) {
+      size_t mid = a + (b - a)/2;
+      size_t m = m_rmq(a, mid);
+      if (m_values[m] <= c) b = m;
+      else a = mid + 1;
+    }
+    return a;
+  }
+
+  public:
+  rmq_lcs_vector() {}
+
+  // values can be any vector of the LCS values (e.g. the int_vector<8> the .lcs file is loaded into)
+  template <class t_vector>
+  rmq_lcs_vector(const t_vector & values) {
+    value_type max_value = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+      max_value = std::max(max_value, (value_type)values[i]);
+      m_min     = std::min(m_min, (value_type)values[i]);
+    }
+    m_values = int_vector<>(values.size(), 0, bits::hi(std::max(max_value, (value_type)1)) + 1);
+    for (size_t i = 0; i < values.size(); i++) m_values[i] = values[i];
+    m_rmq = rmq_succinct_sct<>(&m_values);
+  }
+
+  size_type size() const { return m_values.size(); }
+  value_type operator[](size_type i) const { return m_values[i]; }
+  value_type min() const { return m_min; }
+
+  // Largest p in [1, i] with L[p-1] <= c, or 0 if there isn't one (same as prev_lte on the WT)
+  size_type prev_lte(size_type i, value_type c) const {
+    if (i == 0 || m_min > c) return 0;
+    i = std::min(i, size());
+    size_t lower = (i > scan_len)? i - scan_len : 0;
+    for (size_t p = i; p > lower; p--) {
+      if (m_values[p-1] <= c) return p;
+    }
+    for (size_t width = scan_len; lower > 0; width *= 2) {
+      size_t upper = lower;
+      lower = (upper > width)? upper - width : 0;
+      size_t m = m_rmq(lower, upper-1);
+      if (m_values[m] <= c) return _last_lte(m, upper-1, c) + 1;
+    }
+    return 0;
+  }
+
+  // Smallest p >= i with L[p-1] <= c, or size()+1 if there isn't one (same as next_lte on the WT)
+  size_type next_lte(size_type i, value_type c) const {
+    if (i == 0 || m_min > c) return 0;
+    size_t n = size();
+    if (i > n) return n + 1;
+    size_t upper = std::min(n, i - 1 + scan_len);
+    for (size_t p = i; p <= upper; p++) {
+      if (m_values[p-1] <= c) return p;
+    }
+    for (size_t width = scan_len; upper < n; width *= 2) {
+      size_t lower = upper;
+      upper = std::min(n, lower + width);
+      size_t m = m_rmq(lower, upper-1);
+      if (m_values[m] <= c) return _first_lte(lower, m, c) + 1;
+    }
+    return n + 1;
+  }
+
+  void swap(rmq_lcs_vector & other) {
+    m_values.swap(other.m_values);
+    m_rmq.swap(other.m_rmq);
+    std::swap(m_min, other.m_min);
+  }
+
+  size_type serialize(ostream & out, structure_tree_node * v = nullptr, string name = "") const {
+    structure_tree_node * child = structure_tree::add_child(v, name, util::class_name(*this));
+    size_type written_bytes = 0;
+    written_bytes += m_values.serialize(out, child, "values");
+    written_bytes += m_rmq.serialize(out, child, "rmq");
+    written_bytes += write_member(m_min, out, child, "min");
+    structure_tree::add_size(child, written_bytes);
+    return written_bytes;
+  }
+
+  void load(istream & in) {
+    m_values.load(in);
+    m_rmq.load(in);
+    read_member(m_min, in);
+  }
+};
+
+// The wt_algorithm.hpp functions, so debruijn_hypergraph can take an rmq_lcs_vector as its t_lcs_vector
+inline size_t prev_lte(const rmq_lcs_vector & lcs, size_t i, rmq_lcs_vector::value_type c) {
+  return lcs.prev_lte(i, c);
+}
+
+inline size_t next_lte(const rmq_lcs_vector & lcs, size_t i, rmq_lcs_vector::value_type c) {
+  return lcs.next_lte(i, c);
+}
+
+inline void prev_lte_batch(const rmq_lcs_vector & lcs, const size_t * is, size_t n, rmq_lcs_vector::value_type c,
+                           size_t * out) {
+  for (size_t q = 0; q < n; q++) out[q] = lcs.prev_lte(is[q], c);
+}
+
+inline void next_lte_batch(const rmq_lcs_vector & lcs, const size_t * is, size_t n, rmq_lcs_vector::value_type c,
+                           size_t * out) {
+  for (size_t q = 0; q < n; q++) out[q] = lcs.next_lte(is[q], c);
+}
+
+// For lte_range and range_lte
+template <>
+class lte_finder<rmq_lcs_vector> {
+  const rmq_lcs_vector &     m_lcs;
+  rmq_lcs_vector::value_type m_c;
+
+  public:
+  lte_finder(const rmq_lcs_vector & lcs, rmq_lcs_vector::value_type c) : m_lcs(lcs), m_c(c) {}
+  bool empty() const { return m_lcs.min() > m_c; }
+  size_t operator()(size_t i) const { return m_lcs.next_lte(i, m_c); }
+};
+
+#endif
@@ -0,0 +1,460 @@
+#pragma once
+#ifndef _MAPPED_GRAPH_H
+#define _MAPPED_GRAPH_H
+
+// A memory mappable layout for debruijn_graph (.dbg.mmap files). The file is mapped read-only and queried in place,
+// so loading is independent of the graph size, and several processes querying the same graph share one copy in
+// the page cache. The layout (all little endian, sections 64-byte aligned):
+//   header     : mapped_graph_header
+//   node flags : n, bits (64 per word), rank samples (ones before each 512 bit superblock)
+//   edges      : n, symbols (4 bits each, 16 per word), per superblock (64K symbols) uint64 counts of each symbol
+//                before it, per block (256 symbols) uint16 counts of each symbol before it within its superblock
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "debruijn_graph.hpp"
+#include "utility.hpp"
+
+using namespace std;
+
+static const char     MAPPED_GRAPH_MAGIC[8] = {'C','O','S','M','O','D','B','G'};
+static const uint64_t MAPPED_GRAPH_VERSION  = 1;
+static const size_t   MAPPED_ALIGNMENT      = 64;
+
+struct mapped_graph_header {
+  char     magic[8];
+  uint64_t version;
+  uint64_t k;
+  uint64_t symbol_ends[5];
+  uint64_t alphabet_size;
+  char     alphabet[8];
+  uint64_t node_flags_offset;
+  uint64_t edges_offset;
+  uint64_t file_size;
+};
+
+// Keeps a read-only mapping alive for as long as any view into it exists
+class mapped_region {
+  void * _data = MAP_FAILED;
+  size_t _size = 0;
+
+  public:
+  mapped_region(const string & filename) {
+    int handle = open(filename.c_str(), O_RDONLY);
+    if (handle == -1) throw runtime_error("Can't open " + filename);
+    struct stat st;
+    if (fstat(handle, &st) == -1) {
+      close(handle);
+      throw runtime_error("Can't stat " + filename);
+    }
+    _size = st.st_size;
+    _data = mmap(0, _size, PROT_READ, MAP_SHARED, handle, 0);
+    close(handle);
+    if (_data == MAP_FAILED) throw runtime_error("Can't map " + filename);
+    // Queries jump all over the graph
+    madvise(_data, _size, MADV_RANDOM);
+  }
+
+  ~mapped_region() {
+    if (_data != MAP_FAILED) munmap(_data, _size);
+  }
+
+  const char * data() const { return (const char*)_data; }
+  size_t size() const { return _size; }
+};
+
+// Bit vector view with rank and select support (in the style of sdsl's, so it can be a debruijn_graph parameter)
+class mapped_bit_vector {
+  public:
+  typedef uint64_t size_type;
+  typedef uint64_t value_type;
+  static const size_t superblock_bits = 512;
+
+  template <uint8_t t_b> class rank_support;
+  template <uint8_t t_b> class select_support;
+  typedef rank_support<0>   rank_0_type;
+  typedef rank_support<1>   rank_1_type;
+  typedef select_support<0> select_0_type;
+  typedef select_support<1> select_1_type;
+
+  private:
+  std::shared_ptr<mapped_region> _region;
+  const uint64_t * _words = 0;
+  const uint64_t * _ranks = 0;
+  size_t _size = 0;
+
+  public:
+  mapped_bit_vector() {}
+  // section points to the start of the node flags section in region
+  mapped_bit_vector(std::shared_ptr<mapped_region> region, const uint64_t * section) : _region(region) {
+    _size  = section[0];
+    _words = section + 1;
+    _ranks = _words + num_words(_size);
+  }
+
+  static size_t num_words(size_t n) { return (n + 63) / 64; }
+  static size_t num_superblocks(size_t n) { return (n + superblock_bits - 1) / superblock_bits; }
+  // Bytes taken by the section for n bits
+  static size_t section_bytes(size_t n) { return (1 + num_words(n) + num_superblocks(n) + 1) * sizeof(uint64_t); }
+
+  size_type size() const { return _size; }
+  value_type operator[](size_type i) const { return (_words[i/64] >> (i%64)) & 1; }
+
+  // len (<= 64) bits starting at idx, as in sdsl
+  uint64_t get_int(size_type idx, uint8_t len = 64) const {
+    size_t w = idx / 64, offset = idx % 64;
+    uint64_t x = _words[w] >> offset;
+    if (offset > 0 && offset + len > 64) x |= _words[w+1] << (64 - offset);
+    return (len == 64)? x : x & ((1ULL << len) - 1);
+  }
+
+  // touches what rank1(i) will read (see PREFETCH in utility.hpp)
+  void prefetch(size_t i) const {
+    __builtin_prefetch(_ranks + i / superblock_bits);
+    __builtin_prefetch(_words + i / 64);
+  }
+
+  // ones in [0, i)
+  size_t rank1(size_t i) const {
+    size_t s = i / superblock_bits;
+    size_t r = _ranks[s];
+    for (size_t w = s * (superblock_bits/64); w < i/64; w++) r += __builtin_popcountll(_words[w]);
+    if (i % 64) r += __builtin_popcountll(_words[i/64] & ((1ULL << (i%64)) - 1));
+    return r;
+  }
+
+  // position of the j-th (1-based) t_b bit, or size() if there isn't one
+  template <uint8_t t_b>
+  size_t select(size_t j) const {
+    auto before = [&](size_t s) -> size_t {
+      size_t ones = _ranks[s];
+      return (t_b)? ones : std::min(s * superblock_bits, _size) - ones;
+    };
+    size_t num_super = num_superblocks(_size);
+    if (j == 0 || j > before(num_super)) return _size;
+    // largest superblock with fewer than j before it
+    size_t lo = 0, hi = num_super;
+    while (hi - lo > 1) {
+      size_t mid = lo + (hi - lo)/2;
+      if (before(mid) < j) lo = mid;
+      else hi = mid;
+    }
+    j -= before(lo);
+    for (size_t w = lo * (superblock_bits/64); ; w++) {
+      uint64_t x = (t_b)? _words[w] : ~_words[w];
+      size_t count = __builtin_popcountll(x);
+      if (count >= j) return w * 64 + _select_in_word(x, j-1);
+      j -= count;
+    }
+  }
+
+  size_type serialize(ostream & out, structure_tree_node * = nullptr, string = "") const {
+    size_t bytes = section_bytes(_size);
+    out.write((const char*)(_words - 1), bytes);
+    return bytes;
+  }
+
+  // Writes the section for the bits given by access(i) for i in [0, n)
+  template <class Access>
+  static void write_section(ostream & out, size_t n, Access access) {
+    uint64_t t_n = n;
+    out.write((const char*)&t_n, sizeof(uint64_t));
+    vector<uint64_t> ranks(1, 0);
+    uint64_t ones = 0;
+    for (size_t w = 0; w < num_words(n); w++) {
+      uint64_t word = 0;
+      for (size_t b = 0; b < 64 && w*64 + b < n; b++) word |= (uint64_t)(access(w*64 + b) & 1) << b;
+      out.write((const char*)&word, sizeof(uint64_t));
+      ones += __builtin_popcountll(word);
+      if ((w+1) % (superblock_bits/64) == 0) ranks.push_back(ones);
+    }
+    // the total goes after the last (possibly partial) superblock
+    ranks.resize(num_superblocks(n) + 1, ones);
+    out.write((const char*)&ranks[0], ranks.size() * sizeof(uint64_t));
+  }
+};
+
+
+template <uint8_t t_b>
+class mapped_bit_vector::rank_support {
+  mapped_bit_vector _v;
+  public:
+  rank_support(const mapped_bit_vector * v = nullptr) { if (v) _v = *v; }
+  size_t operator()(size_t i) const { return (t_b)? _v.rank1(i) : i - _v.rank1(i); }
+  size_t rank(size_t i) const { return (*this)(i); }
+  void set_vector(const mapped_bit_vector * v) { if (v) _v = *v; }
+  size_type serialize(ostream &, structure_tree_node * = nullptr, string = "") const { return 0; } // part of the bit vector
+};
+
+template <uint8_t t_b>
+class mapped_bit_vector::select_support {
+  mapped_bit_vector _v;
+  public:
+  select_support(const mapped_bit_vector * v = nullptr) { if (v) _v = *v; }
+  size_t operator()(size_t j) const { return _v.select<t_b>(j); }
+  size_t select(size_t j) const { return (*this)(j); }
+  void set_vector(const mapped_bit_vector * v) { if (v) _v = *v; }
+  size_type serialize(ostream &, structure_tree_node * = nullptr, string = "") const { return 0; } // part of the bit vector
+};
+
+// Sequence of up to 16 distinct symbols (4 bits each) with rank and select, as used for the edges of a debruijn_graph
+// (the W symbols with their flags take values 0..9 for DNA)
+class mapped_edge_vector {
+  public:
+  typedef uint64_t size_type;
+  typedef uint8_t  value_type;
+  static const size_t max_symbols       = 16;
+  static const size_t block_size        = 256;
+  static const size_t superblock_size   = 1 << 16;
+  static const size_t symbols_per_word  = 16;
+  static const uint64_t nibble_ones     = 0x1111111111111111ULL;
+
+  private:
+  std::shared_ptr<mapped_region> _region;
+  const uint64_t * _words = 0;
+  const uint64_t * _super_counts = 0;
+  const uint16_t * _block_counts = 0;
+  size_t _size = 0;
+
+  // bitmask with bit 4j set if symbol j of x is c
+  static uint64_t _matches(uint64_t x, value_type c) {
+    uint64_t y = x ^ (c * nibble_ones);
+    return ~(y | (y >> 1) | (y >> 2) | (y >> 3)) & nibble_ones;
+  }
+
+  // mask of the nibbles 0..t of a word
+  static uint64_t _nibbles_upto(size_t t) { return (t >= symbols_per_word - 1)? ~0ULL : (1ULL << (4 * (t+1))) - 1; }
+
+  size_t _before_super(size_t s, value_type c) const { return _super_counts[s * max_symbols + c]; }
+  size_t _before_block(size_t b, value_type c) const {
+    return _super_counts[(b * block_size / superblock_size) * max_symbols + c] + _block_counts[b * max_symbols + c];
+  }
+
+  public:
+  mapped_edge_vector() {}
+  mapped_edge_vector(std::shared_ptr<mapped_region> region, const uint64_t * section) : _region(region) {
+    _size = section[0];
+    _words = section + 1;
+    _super_counts = _words + num_words(_size);
+    _block_counts = (const uint16_t*)(_super_counts + (num_superblocks(_size) + 1) * max_symbols);
+  }
+
+  static size_t num_words(size_t n) { return (n + symbols_per_word - 1) / symbols_per_word; }
+  static size_t num_blocks(size_t n) { return (n + block_size - 1) / block_size; }
+  static size_t num_superblocks(size_t n) { return (n + superblock_size - 1) / superblock_size; }
+  static size_t section_bytes(size_t n) {
+    return (1 + num_words(n) + (num_superblocks(n) + 1) * max_symbols) * sizeof(uint64_t) +
+           (num_blocks(n) + 1) * max_symbols * sizeof(uint16_t);
+  }
+
+  size_type size() const { return _size; }
+  value_type operator[](size_type i) const {
+    return (_words[i/symbols_per_word] >> (4 * (i%symbols_per_word))) & 0xF;
+  }
+
+  // touches what rank(i, c) and operator[](i) will read (see PREFETCH in utility.hpp)
+  void prefetch(size_t i) const {
+    __builtin_prefetch(_block_counts + (i / block_size) * max_symbols);
+    __builtin_prefetch(_words + i / symbols_per_word);
+  }
+
+  // occurrences of c in [0, i)
+  size_type rank(size_type i, value_type c) const {
+    size_t b = i / block_size;
+    size_t r = _before_block(b, c);
+    size_t last_word = i / symbols_per_word;
+    for (size_t w = b * (block_size/symbols_per_word); w < last_word; w++) {
+      r += __builtin_popcountll(_matches(_words[w], c));
+    }
+    if (i % symbols_per_word) {
+      r += __builtin_popcountll(_matches(_words[last_word], c) & ((1ULL << (4 * (i%symbols_per_word))) - 1));
+    }
+    return r;
+  }
+
+  // position of the j-th (1-based) occurrence of c, or size() if there isn't one
+  size_type select(size_type j, value_type c) const {
+    size_t num_super = num_superblocks(_size);
+    if (j == 0 || j > _before_super(num_super, c)) return _size;
+    size_t lo = 0, hi = num_super;
+    while (hi - lo > 1) {
+      size_t mid = lo + (hi - lo)/2;
+      if (_before_super(mid, c) < j) lo = mid;
+      else hi = mid;
+    }
+    // then the last block in that superblock with fewer than j before it
+    size_t b_lo = lo * (superblock_size/block_size);
+    size_t b_hi = std::min(b_lo + superblock_size/block_size, num_blocks(_size));
+    while (b_hi - b_lo > 1) {
+      size_t mid = b_lo + (b_hi - b_lo)/2;
+      if (_before_block(mid, c) < j) b_lo = mid;
+      else b_hi = mid;
+    }
+    j -= _before_block(b_lo, c);
+    for (size_t w = b_lo * (block_size/symbols_per_word); ; w++) {
+      uint64_t m = _matches(_words[w], c);
+      size_t count = __builtin_popcountll(m);
+      if (count >= j) return w * symbols_per_word + _select_in_word(m, j-1) / 4;
+      j -= count;
+    }
+  }
+
+  // Largest p in [lower, i] holding c or d, or size() if there isn't one (see interleaved_edge_vector). Up to
+  // scan_words words before i are scanned directly, then it falls back to rank and select.
+  size_type prev_occurrence(size_type i, value_type c, value_type d, size_type lower = 0) const {
+    static const size_t scan_words = 8;
+    size_t first_word = i / symbols_per_word;
+    size_t scan_start = std::max((size_t)lower, (first_word >= scan_words)? (first_word - scan_words) * symbols_per_word : 0);
+    for (size_t w = first_word + 1; w-- > scan_start / symbols_per_word;) {
+      uint64_t m = _matches(_words[w], c) | _matches(_words[w], d);
+      size_t word_start = w * symbols_per_word;
+      if (w == first_word) m &= _nibbles_upto(i - word_start);
+      if (scan_start > word_start) m &= ~_nibbles_upto(scan_start - word_start - 1);
+      if (m) return word_start + (63 - __builtin_clzll(m)) / 4;
+    }
+    if (scan_start == lower) return _size;
+    size_t best = _size;
+    for (value_type e : {c, d}) {
+      size_t r = rank(scan_start, e);
+      if (r == 0) continue;
+      size_t pos = select(r, e);
+      if (pos >= lower && (best == _size || pos > best)) best = pos;
+    }
+    return best;
+  }
+
+  size_type serialize(ostream & out, structure_tree_node * = nullptr, string = "") const {
+    size_t bytes = section_bytes(_size);
+    out.write((const char*)(_words - 1), bytes);
+    return bytes;
+  }
+
+  // Writes the section for the symbols given by access(i) for i in [0, n)
+  template <class Access>
+  static void write_section(ostream & out, size_t n, Access access) {
+    uint64_t t_n = n;
+    out.write((const char*)&t_n, sizeof(uint64_t));
+    vector<uint64_t> super_counts; // counts before each superblock
+    vector<uint16_t> block_counts; // counts before each block, relative to its superblock
+    array<uint64_t, max_symbols> counts{};
+    auto push_block_counts = [&](size_t b) {
+      size_t s = b * block_size / superblock_size;
+      for (size_t c = 0; c < max_symbols; c++) block_counts.push_back(counts[c] - super_counts[s * max_symbols + c]);
+    };
+    uint64_t word = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (i % superblock_size == 0) super_counts.insert(super_counts.end(), counts.begin(), counts.end());
+      if (i % block_size == 0) push_block_counts(i / block_size);
+      value_type c = access(i);
+      if (c >= max_symbols) throw runtime_error("mapped_edge_vector only supports 16 symbols");
+      counts[c]++;
+      word |= (uint64_t)c << (4 * (i % symbols_per_word));
+      if ((i+1) % symbols_per_word == 0 || i+1 == n) {
+        out.write((const char*)&word, sizeof(uint64_t));
+        word = 0;
+      }
+    }
+    // one past the end (the totals), so that rank(n) and the select bounds don't need special cases
+    super_counts.insert(super_counts.end(), counts.begin(), counts.end());
+    push_block_counts(num_blocks(n));
+    out.write((const char*)&super_counts[0], super_counts.size() * sizeof(uint64_t));
+    out.write((const char*)&block_counts[0], block_counts.size() * sizeof(uint16_t));
+  }
+};
+
+typedef debruijn_graph<4, mapped_bit_vector, mapped_bit_vector::rank_0_type, mapped_bit_vector::select_0_type,
+                       mapped_edge_vector> mapped_debruijn_graph;
+
+inline void _pad_to_alignment(ostream & out) {
+  static const char zeros[MAPPED_ALIGNMENT] = {};
+  size_t pos = out.tellp();
+  if (pos % MAPPED_ALIGNMENT) out.write(zeros, MAPPED_ALIGNMENT - pos % MAPPED_ALIGNMENT);
+}
+
+// Writes any debruijn_graph (e.g. one loaded from a .dbg file) in the mappable layout
+template <class t_graph>
+void store_mapped_to_file(const t_graph & g, const string & filename) {
+  ofstream out(filename, ios::out | ios::binary);
+  if (!out) throw runtime_error("Can't open " + filename);
+  if (g.m_alphabet.size() > sizeof(mapped_graph_header::alphabet)) throw runtime_error("Alphabet too large to map");
+
+  mapped_graph_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MAPPED_GRAPH_MAGIC, sizeof(header.magic));
+  header.version = MAPPED_GRAPH_VERSION;
+  header.k = g.k;
+  for (size_t i = 0; i < 5; i++) header.symbol_ends[i] = g.m_symbol_ends[i];
+  header.alphabet_size = g.m_alphabet.size();
+  memcpy(header.alphabet, g.m_alphabet.data(), g.m_alphabet.size());
+  out.write((const char*)&header, sizeof(header));
+
+  _pad_to_alignment(out);
+  header.node_flags_offset = out.tellp();
+  mapped_bit_vector::write_section(out, g.m_node_flags.size(), [&](size_t i) { return g.m_node_flags[i]; });
+  _pad_to_alignment(out);
+  header.edges_offset = out.tellp();
+  mapped_edge_vector::write_section(out, g.m_edges.size(), [&](size_t i) { return g.m_edges[i]; });
+  header.file_size = out.tellp();
+
+  // now that the offsets are known
+  out.seekp(0);
+  out.write((const char*)&header, sizeof(header));
+  if (!out) throw runtime_error("Error writing " + filename);
+}
+
+// Maps a file written by store_mapped_to_file. The returned graph (and any copies of it) keep the mapping alive.
+inline mapped_debruijn_graph map_graph_from_file(const string & filename) {
+  std::shared_ptr<mapped_region> region = std::make_shared<mapped_region>(filename);
+  const mapped_graph_header * header = (const mapped_graph_header*)region->data();
+  if (region->size() < sizeof(mapped_graph_header) ||
+      memcmp(header->magic, MAPPED_GRAPH_MAGIC, sizeof(header->magic)) != 0) {
+    throw runtime_error(filename + " is not a mapped cosmo graph");
+  }
+  if (header->version != MAPPED_GRAPH_VERSION) {
+    throw runtime_error(filename + " has an unsupported version (" + to_string(header->version) + ")");
+  }
+  if (header->file_size != region->size()) throw runtime_error(filename + " is truncated");
+  if (header->alphabet_size > sizeof(header->alphabet)) throw runtime_error(filename + " has a damaged header");
+
+  // The offsets and the sizes stored in the sections come from the file, so check that each section is in the
+  // mapping before anything reads it. max_per_byte bounds n first, so that section_bytes(n) can't overflow.
+  auto check_section = [&](uint64_t offset, size_t max_per_byte, size_t (*section_bytes)(size_t)) {
+    if (offset % MAPPED_ALIGNMENT != 0 || offset < sizeof(mapped_graph_header) ||
+        offset > region->size() || region->size() - offset < sizeof(uint64_t)) {
+      throw runtime_error(filename + " has a damaged header (section offset " + to_string(offset) + ")");
+    }
+    uint64_t n = *(const uint64_t*)(region->data() + offset);
+    if (n / max_per_byte > region->size() - offset || section_bytes(n) > region->size() - offset) {
+      throw runtime_error(filename + " has a damaged section at offset " + to_string(offset));
+    }
+    return n;
+  };
+  uint64_t num_flags = check_section(header->node_flags_offset, 8, mapped_bit_vector::section_bytes);
+  uint64_t num_edges = check_section(header->edges_offset, 2, mapped_edge_vector::section_bytes);
+  for (size_t i = 1; i < 5; i++) {
+    if (header->symbol_ends[i] < header->symbol_ends[i-1]) throw runtime_error(filename + " has a damaged header");
+  }
+  if (num_flags != num_edges || header->symbol_ends[4] != num_edges) {
+    throw runtime_error(filename + " has a damaged header (section sizes don't match the edges)");
+  }
+
+  mapped_bit_vector  node_flags(region, (const uint64_t*)(region->data() + header->node_flags_offset));
+  mapped_edge_vector edges(region, (const uint64_t*)(region->data() + header->edges_offset));
+  array<size_t, 5> symbol_ends;
+  for (size_t i = 0; i < 5; i++) symbol_ends[i] = header->symbol_ends[i];
+  string alphabet(header->alphabet, header->alphabet_size);
+  return mapped_debruijn_graph::load_from_components(header->k, node_flags, edges, symbol_ends, alphabet);
+}
+
+#endif
@@ -0,0 +1,519 @@
+#pragma once
+#ifndef PACK_HPP
+#define PACK_HPP
+
+// The kmer sorting and dummy edge merging stages of cosmo-pack, as a library so they can also feed a graph
+// straight into cosmo (see cosmo.cpp) instead of through a .packed file. The visitors take
+// (edge_tag, kmer, k, first start node flag (or LCS), first end node flag) in colex order.
+#include <iostream>
+#include <utility>
+#include <type_traits> // integral_constant
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/resource.h> // getrusage
+
+#include "uint128_t.hpp"
+#include "wide_uint.hpp"
+#include "kmer.hpp"
+#include "kmer_kernels.hpp"
+#include "io.hpp"
+#include "sort.hpp"
+#include "dummies.hpp"
+#include "debug.h"
+
+using namespace std;
+
+// The single nt passes of sort_kmers over [0, k), which are unrolled when k is a static_k
+template <typename kmer_t>
+void _sort_nts(kmer_t * a, kmer_t * b, size_t num_records, const uint32_t k, kmer_t ** new_a, kmer_t ** new_b,
+               size_t num_threads) {
+  colex_partial_radix_sort<DNA_RADIX>(a, b, num_records, 0, k, new_a, new_b, get_nt_functor<kmer_t>(), num_threads);
+}
+
+template <typename kmer_t, uint32_t K>
+void _sort_nts(kmer_t * a, kmer_t * b, size_t num_records, static_k<K>, kmer_t ** new_a, kmer_t ** new_b,
+               size_t num_threads) {
+  colex_static_radix_sort<DNA_RADIX, 0, K>(a, b, num_records, new_a, new_b, get_nt_functor<kmer_t>(), num_threads);
+}
+
+// Converts the kmers, appends their reverse complements and sorts them. After this, table_a will be in
+// <colex(node), edge> order and table_b in colex(row) order (both point into kmers, which needs space for
+// 2 * revcomp_factor * num_kmers). Returns the number of records in each table.
+// k can be a uint32_t or a static_k (as for the other functions in here, except convert_external).
+template <typename kmer_t, typename t_k>
+size_t sort_kmers(kmer_t * kmers, size_t num_kmers, const t_k k, kmer_t ** out_a, kmer_t ** out_b,
+                  size_t num_threads = 1, size_t nts_per_pass = 1) {
+  // Convert the nucleotide representation to allow tricks, and append reverse complements (in the same pass)
+  auto convert_start = chrono::high_resolution_clock::now();
+  #ifdef ADD_REVCOMPS
+  size_t revcomp_factor = 2;
+  convert_kmers(kmers, kmers, num_kmers, kmers + num_kmers, k);
+  #else
+  size_t revcomp_factor = 1;
+  convert_kmers(kmers, kmers, num_kmers, (kmer_t*)0, k);
+  #endif
+  fprintf(stderr, "Converted %zu kmers in %.3f s (%s)\n", num_kmers,
+          chrono::duration<double>(chrono::high_resolution_clock::now() - convert_start).count(),
+          kernel_isa_name(best_kernel_isa_for<kmer_t>()));
+
+  // NOTE: There might be a way to do this recursively using counting (and not two tables)
+  // After the sorting phase, Table A will in <colex(node), edge> order (as required for output)
+  // and Table B will be in colex(row) order. Having both tables is helpful for detecting the missing dummy
+  // edges with a simple O(N) merge-join algorithm.
+  // NOTE: THESE SHOULD NOT BE FREED (the kmers array is freed by the caller)
+  kmer_t * table_a = kmers;
+  kmer_t * table_b = kmers + num_kmers * revcomp_factor; // x2 because of reverse complements
+  // Sort by last column to do the edge-sorted part of our <colex(node), edge>-sorted table
+  colex_partial_radix_sort<DNA_RADIX>(table_a, table_b, num_kmers * revcomp_factor, 0, 1,
+                                      &table_a, &table_b, get_nt_functor<kmer_t>(), num_threads);
+  // Sort from k to last column (not k to 1 - we need to sort by the edge column a second time to get colex(row) table)
+  // Note: The output names are swapped (we want table a to be the primary table and b to be aux), because our desired
+  // result is the second last iteration (<colex(node), edge>-sorted) but we still have use for the last iteration (colex(row)-sorted).
+  // Hence, table_b is the output sorted from [hi-1 to lo], and table_a is the 2nd last iter sorted from (hi-1 to lo]
+  // The wide versions sort several nucleotides per pass (fewer passes over memory), but still finish with a single
+  // nucleotide pass so that we get the same two tables. They also time each of their passes, while the single
+  // nucleotide sorts are only timed as a whole.
+  vector<double> pass_times;
+  size_t num_passes = k;
+  auto sort_start = chrono::high_resolution_clock::now();
+  switch (nts_per_pass) {
+    case 4:
+      colex_partial_wide_radix_sort<DNA_RADIX, 4>(table_a, table_b, num_kmers * revcomp_factor, 0, k,
+                                                  &table_b, &table_a, get_nts_functor<kmer_t>(), num_threads, &pass_times);
+      num_passes = pass_times.size();
+      break;
+    case 8:
+      colex_partial_wide_radix_sort<DNA_RADIX, 8>(table_a, table_b, num_kmers * revcomp_factor, 0, k,
+                                                  &table_b, &table_a, get_nts_functor<kmer_t>(), num_threads, &pass_times);
+      num_passes = pass_times.size();
+      break;
+    default:
+      _sort_nts(table_a, table_b, num_kmers * revcomp_factor, k, &table_b, &table_a, num_threads);
+  }
+  double sort_secs = chrono::duration<double>(chrono::high_resolution_clock::now() - sort_start).count();
+  for (size_t i = 0; i < pass_times.size(); i++) {
+    TRACE("sort pass %zu: %.3f s\n", i, pass_times[i]);
+  }
+  fprintf(stderr, "Sorted %zu kmers in %zu passes of up to %zu nts (%.3f s, %.3f s/pass on average)\n",
+          num_kmers * revcomp_factor, num_passes, nts_per_pass, sort_secs, sort_secs/num_passes);
+
+  *out_a = table_a;
+  *out_b = table_b;
+  return num_kmers * revcomp_factor;
+}
+
+// Allocates space for the incoming dummies found by find_incoming_dummy_edges (should be freed by the caller)
+template <typename kmer_t, typename t_k>
+void alloc_incoming_dummies(size_t num_incoming_dummies, const t_k k, kmer_t ** incoming_dummies, uint8_t ** incoming_dummy_lengths) {
+  // allocate space for dummies -> we need to generate all the $-prefixed dummies, so can't just use an iterator for the
+  // incoming dummies (the few that we get from the set_difference are the ones we apply $x[0:-1] to, so we need (k-1) more for each
+  // (to make $...$x[0])... times two because we need to radix sort these bitches.
+  #ifdef ALL_DUMMIES
+  size_t all_dummies_factor = (k-1);
+  size_t dummy_table_factor = 2;
+  #else
+  size_t all_dummies_factor = 1;
+  size_t dummy_table_factor = 1;
+  (void)k;
+  #endif
+  // Don't have to alloc if we aren't preparing all dummies, but this option is only used for testing. Usually we want them
+  *incoming_dummies = (kmer_t*) malloc(num_incoming_dummies*all_dummies_factor*dummy_table_factor*sizeof(kmer_t));
+  if (!*incoming_dummies) {
+    cerr << "Error allocating space for incoming dummies" << endl;
+    exit(1);
+  }
+  // We store lengths because the prefix before the <length> symbols on the right will all be $ signs
+  // this is a cheaper way than storing all symbols in 3 bits instead (although it means we need a varlen radix sort)
+  *incoming_dummy_lengths = (uint8_t*) malloc(num_incoming_dummies*all_dummies_factor*dummy_table_factor*sizeof(uint8_t));
+  if (!*incoming_dummy_lengths) {
+    cerr << "Error allocating space for incoming dummy lengths" << endl;
+    exit(1);
+  }
+}
+
+// Arrays can be merged in slices in parallel, anything else is merged sequentially
+template <typename kmer_t, typename t_k, class Visitor>
+void merge_tables(kmer_t * table_a, kmer_t * table_b, size_t num_records, const t_k k,
+                  kmer_t * dummies, size_t num_dummies, uint8_t * lengths, Visitor visit, size_t num_threads) {
+  parallel_merge_dummies(table_a, table_b, num_records, k, dummies, num_dummies, lengths, visit, num_threads);
+}
+
+template <typename kmer_t, class TableA, class TableB, typename t_k, class Visitor>
+void merge_tables(TableA & table_a, TableB & table_b, size_t num_records, const t_k k,
+                  kmer_t * dummies, size_t num_dummies, uint8_t * lengths, Visitor visit, size_t) {
+  merge_dummies(table_a, table_b, num_records, k, dummies, num_dummies, lengths, visit);
+}
+
+// Adds the $-prefixed incoming dummies and merges everything into the visitor.
+// table_a and table_b can be arrays or anything else that can be indexed in increasing order (e.g. merged runs).
+template <typename kmer_t, class TableA, class TableB, typename t_k, class Visitor>
+void merge_incoming_dummies(TableA & table_a, TableB & table_b, size_t num_records, const t_k k,
+                            kmer_t * incoming_dummies, uint8_t * incoming_dummy_lengths, size_t num_incoming_dummies,
+                            Visitor visit, size_t num_threads = 1) {
+  // add extra dummies
+  #ifdef ALL_DUMMIES
+  size_t all_dummies_factor = (k-1);
+  prepare_incoming_dummy_edges(incoming_dummies, incoming_dummy_lengths, num_incoming_dummies, k-1);
+  #else
+  size_t all_dummies_factor = 1;
+  // Just set the lengths for merging
+  memset(incoming_dummy_lengths, k-1, num_incoming_dummies);
+  #endif
+
+  kmer_t * dummies_a = incoming_dummies;
+  uint8_t * lengths_a = incoming_dummy_lengths;
+  // sort dummies (varlen radix)
+  // dont need to sort if not adding the extras, since already sorted
+  #ifdef ALL_DUMMIES
+  kmer_t * dummies_b = incoming_dummies + num_incoming_dummies * (k-1);
+  uint8_t * lengths_b = incoming_dummy_lengths + num_incoming_dummies * (k-1);
+  colex_partial_radix_sort<DNA_RADIX>(dummies_a, dummies_b, num_incoming_dummies*(k-1), 0, 1,
+                                      &dummies_a, &dummies_b, get_nt_functor<kmer_t>(),
+                                      lengths_a, lengths_b, &lengths_a, &lengths_b);
+  // Don't need the last iteration (i.e. dont need to go to 0) since we arent doing a set difference like above
+  colex_partial_radix_sort<DNA_RADIX>(dummies_a, dummies_b, num_incoming_dummies*(k-1), 1, k-1,
+                                      &dummies_a, &dummies_b, get_nt_functor<kmer_t>(),
+                                      lengths_a, lengths_b, &lengths_a, &lengths_b);
+  #endif
+  merge_tables(table_a, table_b, num_records, k,
+               dummies_a, num_incoming_dummies*all_dummies_factor,
+               lengths_a,
+               // edge_tag needed to distinguish between dummy out edge or not...
+               [=](edge_tag tag, const kmer_t & x, const uint32_t x_k, size_t first_start_node, bool first_end_node) {
+                 // TODO: this should be factored into a class that prints full kmers in ascii
+                 // then add a --full option
+                 #ifdef VERBOSE // print each kmer to stderr for testing
+                 if (tag == out_dummy)
+                   cerr << kmer_to_string(get_start_node(x), k-1, k-1) << "$";
+                 else
+                   cerr << kmer_to_string(x, k, x_k);
+                 cerr << " " << first_start_node << " " << first_end_node << endl;
+                 #endif
+                 visit(tag, x, x_k, first_start_node, first_end_node);
+               }, num_threads);
+}
+
+template <typename kmer_t, typename t_k, class Visitor>
+void convert(kmer_t * kmers, size_t num_kmers, const t_k k, Visitor visit, size_t num_threads = 1, size_t nts_per_pass = 1) {
+  kmer_t * table_a = 0;
+  kmer_t * table_b = 0;
+  size_t num_records = sort_kmers(kmers, num_kmers, k, &table_a, &table_b, num_threads, nts_per_pass);
+
+  // outgoing dummy edges are output in correct order while merging, whereas incoming dummy edges are not in the correct
+  // position, but are sorted relatively, hence can be merged if collected in a previous pass
+  // count dummies (to allocate space)
+  size_t num_incoming_dummies = count_incoming_dummy_edges(table_a, table_b, num_records, k);
+  TRACE("num_incoming_dummies: %zu\n", num_incoming_dummies);
+  kmer_t * incoming_dummies = 0;
+  uint8_t * incoming_dummy_lengths = 0;
+  alloc_incoming_dummies(num_incoming_dummies, k, &incoming_dummies, &incoming_dummy_lengths);
+  // extract dummies
+  find_incoming_dummy_edges(table_a, table_b, num_records, k, incoming_dummies);
+  merge_incoming_dummies(table_a, table_b, num_records, k, incoming_dummies, incoming_dummy_lengths, num_incoming_dummies, visit,
+                         num_threads);
+  // TODO: CUDA (the kmer conversion already has SSSE3/AVX2 kernels, see kmer_kernels.hpp)
+
+  free(incoming_dummies);
+  free(incoming_dummy_lengths);
+}
+
+// Nucleotides per level of the in-place sort in convert_low_mem (it isn't set by --nts_per_pass: narrower levels
+// recurse deeper, and wider ones make each small bucket allocate a huge histogram)
+const size_t LOW_MEM_NTS_PER_PASS = 4;
+
+// Shared by the front ends: exits if --nts_per_pass asks --low_mem for a width other than LOW_MEM_NTS_PER_PASS
+// (1 is the default, so it is taken as not given)
+inline void check_low_mem_nts_per_pass(bool low_mem, size_t nts_per_pass) {
+  if (low_mem && nts_per_pass != 1 && nts_per_pass != LOW_MEM_NTS_PER_PASS) {
+    fprintf(stderr, "ERROR: --low_mem always sorts %zu nucleotides per pass, so --nts_per_pass can only be %zu with it.\n",
+            LOW_MEM_NTS_PER_PASS, LOW_MEM_NTS_PER_PASS);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Same as convert, but only needs space for num_kmers * revcomp_factor kmers (i.e. half the memory).
+// Table A is sorted in place (as integers, after moving the edge label to the end), and table B is read
+// from table A through a colex_row_view instead of being stored.
+template <typename kmer_t, typename t_k, class Visitor>
+void convert_low_mem(kmer_t * kmers, size_t num_kmers, const t_k k, Visitor visit, size_t num_threads = 1) {
+  // Convert the nucleotide representation to allow tricks, and append reverse complements (in the same pass)
+  auto convert_start = chrono::high_resolution_clock::now();
+  #ifdef ADD_REVCOMPS
+  size_t revcomp_factor = 2;
+  convert_kmers(kmers, kmers, num_kmers, kmers + num_kmers, k);
+  #else
+  size_t revcomp_factor = 1;
+  convert_kmers(kmers, kmers, num_kmers, (kmer_t*)0, k);
+  #endif
+  fprintf(stderr, "Converted %zu kmers in %.3f s (%s)\n", num_kmers,
+          chrono::duration<double>(chrono::high_resolution_clock::now() - convert_start).count(),
+          kernel_isa_name(best_kernel_isa_for<kmer_t>()));
+  size_t num_records = num_kmers * revcomp_factor;
+
+  auto sort_start = chrono::high_resolution_clock::now();
+  transform(kmers, kmers + num_records, kmers, [k](const kmer_t & x) { return node_edge_to_sortable(x, k); });
+  colex_inplace_radix_sort<LOW_MEM_NTS_PER_PASS>(kmers, num_records, 0, k, get_nts_functor<kmer_t>(), std::less<kmer_t>(), num_threads);
+  transform(kmers, kmers + num_records, kmers, [k](const kmer_t & x) { return node_edge_from_sortable(x, k); });
+  double sort_secs = chrono::duration<double>(chrono::high_resolution_clock::now() - sort_start).count();
+  fprintf(stderr, "Sorted %zu kmers in place (%.3f s)\n", num_records, sort_secs);
+
+  kmer_t * table_a = kmers;
+  std::vector<uint8_t> labels = colex_row_view<kmer_t>::edge_labels(table_a, num_records);
+
+  size_t num_incoming_dummies = 0;
+  {
+    colex_row_view<kmer_t> table_b(table_a, num_records, labels);
+    auto out_count = boost::make_function_output_iterator([&num_incoming_dummies](kmer_t) { num_incoming_dummies++; });
+    find_incoming_dummy_edges_sequential<kmer_t>(table_a, table_b, num_records, k, out_count);
+  }
+  TRACE("num_incoming_dummies: %zu\n", num_incoming_dummies);
+  kmer_t * incoming_dummies = 0;
+  uint8_t * incoming_dummy_lengths = 0;
+  alloc_incoming_dummies(num_incoming_dummies, k, &incoming_dummies, &incoming_dummy_lengths);
+  {
+    colex_row_view<kmer_t> table_b(table_a, num_records, labels);
+    find_incoming_dummy_edges_sequential<kmer_t>(table_a, table_b, num_records, k, incoming_dummies);
+  }
+  colex_row_view<kmer_t> table_b(table_a, num_records, labels);
+  merge_incoming_dummies(table_a, table_b, num_records, k, incoming_dummies, incoming_dummy_lengths, num_incoming_dummies, visit);
+
+  free(incoming_dummies);
+  free(incoming_dummy_lengths);
+}
+
+// Calls f with k as a static_k if it is one of Ks (and kmer_t is the narrowest type it fits in, as in DSK files,
+// so each is only compiled once), or as a uint32_t otherwise. Returns whether it was a static_k.
+template <typename kmer_t, uint32_t... Ks>
+struct _static_k_dispatch {
+  template <class F>
+  static bool run(const uint32_t k, F & f) { f(k); return false; }
+};
+
+template <typename kmer_t, uint32_t K, uint32_t... Ks>
+struct _static_k_dispatch<kmer_t, K, Ks...> {
+  template <class F>
+  static bool run(const uint32_t k, F & f) {
+    if (k != K) return _static_k_dispatch<kmer_t, Ks...>::run(k, f);
+    const size_t width = bitwidth<kmer_t>::width;
+    return _run(k, f, std::integral_constant<bool, (K * NT_WIDTH <= width && K * NT_WIDTH + BLOCK_WIDTH > width)>());
+  }
+
+  template <class F>
+  static bool _run(const uint32_t, F & f, std::true_type) { f(static_k<K>()); return true; }
+  template <class F>
+  static bool _run(const uint32_t k, F & f, std::false_type) { f(k); return false; }
+};
+
+// The common choices of k, which convert_static_k compiles convert and convert_low_mem for
+template <typename kmer_t, class F>
+bool with_static_k(const uint32_t k, F & f) {
+  return _static_k_dispatch<kmer_t, 21, 25, 27, 31, 41, 55, 63>::run(k, f);
+}
+
+template <typename kmer_t, class Visitor>
+struct _convert_f {
+  kmer_t * kmers;
+  size_t   num_kmers;
+  Visitor  visit;
+  size_t   num_threads;
+  size_t   nts_per_pass;
+  bool     low_mem;
+
+  template <typename t_k>
+  void operator()(const t_k k) {
+    if (low_mem) convert_low_mem(kmers, num_kmers, k, visit, num_threads);
+    else convert(kmers, num_kmers, k, visit, num_threads, nts_per_pass);
+  }
+};
+
+// Same as convert (or convert_low_mem), but with k as a static_k if it is one of the common choices, so that the
+// kmer functions and the single nt sort passes have it as a constant. Returns whether it was.
+template <typename kmer_t, class Visitor>
+bool convert_static_k(kmer_t * kmers, size_t num_kmers, const uint32_t k, Visitor visit, size_t num_threads = 1,
+                      size_t nts_per_pass = 1, bool low_mem = false) {
+  _convert_f<kmer_t, Visitor> f{kmers, num_kmers, visit, num_threads, nts_per_pass, low_mem};
+  return with_static_k<kmer_t>(k, f);
+}
+
+// Calls f with kmers as an array of the type kmer_num_bits bit kmers are held in (a width dsk_open accepts), and
+// returns what it returns. kmers can be null (e.g. when converting externally).
+template <class F>
+auto with_kmer_type(uint64_t * kmers, uint32_t kmer_num_bits, F & f) -> decltype(f(kmers)) {
+  switch (kmer_num_bits) {
+    case 64:  return f(kmers);
+    case 128: return f((uint128_t*)kmers);
+    case 192: return f((uint192_t*)kmers);
+    default:  return f((uint256_t*)kmers);
+  }
+}
+
+// Same as convert, but for inputs that don't fit in memory: reads the DSK file (from handle, after the header)
+// in chunks of at most mem_budget bytes worth of tables, sorts each chunk and spills both tables to temporary
+// run files (run_prefix.<i>.a/b), then k-way merges the runs while detecting and merging the dummy edges.
+// The incoming dummies are still kept in memory.
+template <typename kmer_t, class Visitor>
+void convert_external(int handle, uint32_t kmer_num_bits, size_t num_kmers, const uint32_t k, size_t mem_budget,
+                      const string & run_prefix, Visitor visit, size_t num_threads = 1, size_t nts_per_pass = 1) {
+  #ifdef ADD_REVCOMPS
+  size_t revcomp_factor = 2;
+  #else
+  size_t revcomp_factor = 1;
+  #endif
+  size_t chunk_size = std::max((size_t)1, mem_budget / (2 * revcomp_factor * sizeof(kmer_t)));
+  kmer_t * kmers = (kmer_t*)malloc(std::min(chunk_size, num_kmers) * 2 * revcomp_factor * sizeof(kmer_t));
+  if (!kmers) {
+    cerr << "Error allocating space for kmers" << endl;
+    exit(1);
+  }
+
+  // Sort and spill runs
+  vector<string> runs_a, runs_b;
+  size_t num_records = 0;
+  for (size_t remaining = num_kmers; remaining > 0; ) {
+    size_t num_read = dsk_read_kmers(handle, kmer_num_bits, (uint64_t*)kmers, std::min(chunk_size, remaining));
+    if (num_read == 0) {
+      cerr << "Error reading kmers" << endl;
+      exit(1);
+    }
+    remaining -= num_read;
+    kmer_t * table_a = 0;
+    kmer_t * table_b = 0;
+    size_t num_run_records = sort_kmers(kmers, num_read, k, &table_a, &table_b, num_threads, nts_per_pass);
+    num_records += num_run_records;
+    runs_a.push_back(run_prefix + "." + to_string(runs_a.size()) + ".a");
+    runs_b.push_back(run_prefix + "." + to_string(runs_b.size()) + ".b");
+    if (!write_kmer_run(runs_a.back(), table_a, num_run_records) ||
+        !write_kmer_run(runs_b.back(), table_b, num_run_records)) {
+      cerr << "Error writing temporary file " << runs_a.back() << endl;
+      exit(1);
+    }
+  }
+  free(kmers);
+  fprintf(stderr, "Spilled %zu sorted runs of up to %zu kmers\n", runs_a.size(), chunk_size * revcomp_factor);
+
+  // Leave half of the budget for read buffers, split over both sets of runs
+  size_t buffer_len = std::max((size_t)1024, mem_budget / (4 * runs_a.size() * sizeof(kmer_t)));
+  auto a_less = [](const kmer_t & x, const kmer_t & y) { return node_edge_less(x, y); };
+  auto b_less = [](const kmer_t & x, const kmer_t & y) { return x < y; };
+  typedef merged_kmer_runs<kmer_t, decltype(a_less)> merged_a_t;
+  typedef merged_kmer_runs<kmer_t, decltype(b_less)> merged_b_t;
+
+  // First merge pass to find the incoming dummies
+  vector<kmer_t> found_dummies;
+  {
+    merged_a_t table_a(runs_a, a_less, buffer_len);
+    merged_b_t table_b(runs_b, b_less, buffer_len);
+    find_incoming_dummy_edges_sequential<kmer_t>(table_a, table_b, num_records, k, back_inserter(found_dummies));
+  }
+  size_t num_incoming_dummies = found_dummies.size();
+  TRACE("num_incoming_dummies: %zu\n", num_incoming_dummies);
+  kmer_t * incoming_dummies = 0;
+  uint8_t * incoming_dummy_lengths = 0;
+  alloc_incoming_dummies(num_incoming_dummies, k, &incoming_dummies, &incoming_dummy_lengths);
+  copy(found_dummies.begin(), found_dummies.end(), incoming_dummies);
+  vector<kmer_t>().swap(found_dummies);
+
+  // Second merge pass to output everything
+  {
+    merged_a_t table_a(runs_a, a_less, buffer_len);
+    merged_b_t table_b(runs_b, b_less, buffer_len);
+    merge_incoming_dummies(table_a, table_b, num_records, k, incoming_dummies, incoming_dummy_lengths, num_incoming_dummies, visit);
+  }
+
+  free(incoming_dummies);
+  free(incoming_dummy_lengths);
+  for (auto & run : runs_a) remove(run.c_str());
+  for (auto & run : runs_b) remove(run.c_str());
+}
+
+// Opens a DSK file and reads its header and the number of kmers in it. Exits with a message on errors.
+inline int dsk_open(const char * file_name, uint32_t * kmer_num_bits, uint32_t * k, size_t * num_kmers) {
+  int handle = -1;
+  if ( (handle = open(file_name, O_RDONLY)) == -1 ) {
+    fprintf(stderr, "ERROR: Can't open file: %s\n", file_name);
+    exit(EXIT_FAILURE);
+  }
+
+  // Read Header
+  if ( !dsk_read_header(handle, kmer_num_bits, k) ) {
+    fprintf(stderr, "ERROR: Error reading file %s\n", file_name);
+    exit(EXIT_FAILURE);
+  }
+  TRACE(">> READING DSK FILE\n");
+  TRACE("kmer_num_bits, k = %d, %d\n", *kmer_num_bits, *k);
+
+  if (*kmer_num_bits > MAX_BITS_PER_KMER) {
+    fprintf(stderr, "ERROR: Kmers larger than %zu bits are not currently supported."
+                    " %s uses %d bits per kmer (possibly corrupt?).\n",
+            MAX_BITS_PER_KMER, file_name, *kmer_num_bits);
+    exit(EXIT_FAILURE);
+  }
+  if (*kmer_num_bits == 0 || *kmer_num_bits % BLOCK_WIDTH != 0) {
+    fprintf(stderr, "ERROR: %s uses %d bits per kmer, which isn't a multiple of %d (possibly corrupt?).\n",
+            file_name, *kmer_num_bits, BLOCK_WIDTH);
+    exit(EXIT_FAILURE);
+  }
+
+  // Read how many items there are (for allocation purposes)
+  if ( dsk_num_records(handle, *kmer_num_bits, num_kmers) == -1) {
+    fprintf(stderr, "Error seeking file %s\n", file_name);
+    exit(EXIT_FAILURE);
+  }
+  if (*num_kmers == 0) {
+    fprintf(stderr, "ERROR: File %s has no kmers (possibly corrupt?).\n", file_name);
+    exit(EXIT_FAILURE);
+  }
+  TRACE("num_kmers = %zu\n", *num_kmers);
+  return handle;
+}
+
+// Allocates table_bytes and reads all the kmers of an opened DSK file into the start of it (then closes the file).
+// Exits with a message on errors.
+inline uint64_t * dsk_read_all_kmers(int handle, const char * file_name, uint32_t kmer_num_bits, size_t num_kmers,
+                                     size_t table_bytes, bool use_mmap, size_t num_threads) {
+  uint64_t * kmer_blocks = (uint64_t*)malloc(table_bytes);
+  if (!kmer_blocks) {
+    cerr << "Error allocating space for kmers" << endl;
+    exit(1);
+  }
+
+  // READ KMERS FROM DISK INTO ARRAY
+  auto read_start = chrono::high_resolution_clock::now();
+  size_t num_records_read = (use_mmap)?
+    dsk_read_kmers_mmap(handle, kmer_num_bits, kmer_blocks, num_threads) :
+    dsk_read_kmers(handle, kmer_num_bits, kmer_blocks);
+  auto read_end = chrono::high_resolution_clock::now();
+  close(handle);
+  if (num_records_read == 0) {
+    fprintf(stderr, "Error reading file %s\n", file_name);
+    exit(EXIT_FAILURE);
+  }
+  TRACE("num_records_read = %zu\n", num_records_read);
+  assert (num_records_read == num_kmers);
+  (void)num_kmers;
+
+  double read_secs = chrono::duration<double>(read_end - read_start).count();
+  double read_gb   = num_records_read * DSK_FILE_RECORD_SIZE(kmer_num_bits) / 1e9;
+  fprintf(stderr, "Read %.3f GB in %.3f s (%.2f GB/s, %s)\n", read_gb, read_secs,
+          (read_secs > 0)? read_gb/read_secs : 0.0, (use_mmap)? "mmap" : "read");
+  return kmer_blocks;
+}
+
+// Peak resident set size of this process so far (in MB)
+inline double peak_rss_mb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  #ifdef __APPLE__
+  return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+  #else
+  return usage.ru_maxrss / 1024.0; // kilobytes
+  #endif
+}
+
+#endif
@@ -0,0 +1,403 @@
+#pragma once
+#ifndef READS_HPP
+#define READS_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+
+#include <zlib.h>
+
+#include "uint128_t.hpp"
+#include "wide_uint.hpp"
+#include "kmer.hpp"
+#include "debug.h"
+
+using namespace std;
+
+// Counting the kmers of FASTA/FASTQ reads ourselves, so cosmo-pack and cosmo don't need a DSK file. The kmers come
+// out as dsk_read_kmers gives them (canonical, in DSK's nt codes and block order), so everything after is the same.
+// The reader thread decompresses and parses the file into batches of sequences, and the workers extract the kmers
+// with a rolling encoder and hash them to partitions, which count them in hash tables (see _kmer_partition).
+
+// Reads the lines of a file, which can be gzipped (zlib reads uncompressed files as they are)
+class gz_line_reader {
+  gzFile       _file;
+  vector<char> _buffer;
+  size_t       _pos = 0;
+  size_t       _len = 0;
+  bool         _eof = false;
+
+  public:
+  gz_line_reader(const char * file_name, size_t buffer_len = 1 << 20) : _buffer(buffer_len) {
+    _file = gzopen(file_name, "rb");
+    if (_file) gzbuffer(_file, buffer_len);
+  }
+  ~gz_line_reader() { if (_file) gzclose(_file); }
+
+  bool is_open() const { return _file != 0; }
+
+  // Reads the next line into line (without the newline, or a \r before it). Returns false at the end of the file.
+  bool getline(string & line) {
+    line.clear();
+    while (true) {
+      if (_pos == _len) {
+        if (_eof) return !line.empty();
+        int num_read = gzread(_file, _buffer.data(), _buffer.size());
+        if (num_read < 0) {
+          int err = 0;
+          fprintf(stderr, "ERROR: Error reading input (%s)\n", gzerror(_file, &err));
+          exit(EXIT_FAILURE);
+        }
+        _pos = 0;
+        _len = num_read;
+        _eof = num_read == 0;
+        continue;
+      }
+      const char * start = _buffer.data() + _pos;
+      const char * end   = (const char*)memchr(start, '\n', _len - _pos);
+      if (!end) {
+        line.append(start, _len - _pos);
+        _pos = _len;
+        continue;
+      }
+      line.append(start, end - start);
+      _pos += end - start + 1;
+      if (!line.empty() && line[line.size()-1] == '\r') line.resize(line.size()-1);
+      return true;
+    }
+  }
+};
+
+// Splits the sequences of a FASTA or FASTQ file (told apart by the first character of each record) into batches of
+// about batch_len bases. Longer sequences (e.g. whole chromosomes) are split into pieces that overlap by k-1 bases,
+// so each of their kmers is in exactly one piece.
+class read_batcher {
+  gz_line_reader _in;
+  const char *   _file_name;
+  uint32_t       _k;
+  size_t         _batch_len;
+  string         _line;
+  bool           _have_header = false; // _line holds the header of the next record
+  bool           _in_fasta    = false; // the last piece was cut from a FASTA record that continues
+  string         _carry;               // the last k-1 bases of that piece
+
+  // Next sequence, or next piece of one. Returns false at the end of the file.
+  bool next_piece(string & seq) {
+    if (_in_fasta) seq = _carry;
+    else {
+      if (!_have_header) {
+        do { if (!_in.getline(_line)) return false; } while (_line.empty());
+      }
+      _have_header = false;
+      num_sequences++;
+      seq.clear();
+      // (a DSK file starts with '@' too, but has NULs in its "header")
+      if ((_line[0] != '>' && _line[0] != '@') || memchr(_line.data(), '\0', _line.size())) {
+        fprintf(stderr, "ERROR: %s isn't a FASTA or FASTQ file.\n", _file_name);
+        exit(EXIT_FAILURE);
+      }
+      if (_line[0] == '@') {
+        while (_in.getline(_line) && (_line.empty() || _line[0] != '+')) seq += _line;
+        // Quality lines can start with anything, so they are skipped by length
+        for (size_t qual_len = 0; qual_len < seq.size() && _in.getline(_line);) qual_len += _line.size();
+        return true;
+      }
+    }
+    _in_fasta = false;
+    while (_in.getline(_line)) {
+      if (!_line.empty() && _line[0] == '>') {
+        _have_header = true;
+        return true;
+      }
+      seq += _line;
+      if (seq.size() >= _batch_len + _k) {
+        _in_fasta = true;
+        _carry = seq.substr(seq.size() - (_k - 1));
+        return true;
+      }
+    }
+    return true;
+  }
+
+  public:
+  size_t num_sequences = 0;
+  size_t num_bases     = 0;
+
+  read_batcher(const char * file_name, uint32_t k, size_t batch_len = 1 << 20)
+    : _in(file_name), _file_name(file_name), _k(k), _batch_len(batch_len) {
+    if (!_in.is_open()) {
+      fprintf(stderr, "ERROR: Can't open file: %s\n", file_name);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // Fills batch with the next sequences. Returns false when there are none left.
+  bool next(vector<string> & batch) {
+    batch.clear();
+    size_t bases = 0;
+    string seq;
+    while (bases < _batch_len && next_piece(seq)) {
+      bases += seq.size();
+      batch.push_back(std::move(seq));
+    }
+    num_bases += bases;
+    return !batch.empty();
+  }
+};
+
+// 2 bit codes of the nts as DSK stores them (A = 0, C = 1, T = 2, G = 3, so the complement of x is x^2),
+// and 4 for anything else (e.g. N)
+struct _dsk_nt_codes {
+  uint8_t code[256];
+  _dsk_nt_codes() {
+    memset(code, 4, sizeof(code));
+    code['A'] = code['a'] = 0;
+    code['C'] = code['c'] = 1;
+    code['T'] = code['t'] = 2;
+    code['G'] = code['g'] = 3;
+  }
+};
+
+// Calls visit with each kmer of seq that only has ACGT in it, in its canonical form (the smaller of it and its
+// reverse complement, as DSK keeps). Both are rolled along one nt at a time.
+template <typename kmer_t, class Visitor>
+void for_each_canonical_kmer(const string & seq, const uint32_t k, Visitor & visit) {
+  static const _dsk_nt_codes codes;
+  const kmer_t mask = (k * NT_WIDTH == bitwidth<kmer_t>::width)? ~kmer_t(0) : ~(~kmer_t(0) << (k * NT_WIDTH));
+  const uint32_t top = (k - 1) * NT_WIDTH;
+  kmer_t fwd(0), rev(0);
+  size_t len = 0;
+  for (char c : seq) {
+    uint8_t x = codes.code[(uint8_t)c];
+    if (x > 3) {
+      len = 0;
+      continue;
+    }
+    fwd = ((fwd << NT_WIDTH) | x) & mask;
+    rev = (rev >> NT_WIDTH) | (kmer_t(x ^ 2) << top);
+    if (++len >= k) visit((fwd < rev)? fwd : rev);
+  }
+}
+
+// Multiplicative hash of all the blocks of a kmer (the high bits are the well mixed ones)
+template <typename kmer_t>
+inline uint64_t _kmer_hash(const kmer_t & x) {
+  const uint64_t * blocks = (const uint64_t*)&x;
+  uint64_t h = 0;
+  for (size_t b = 0; b < sizeof(kmer_t) / sizeof(uint64_t); b++) h = (h ^ blocks[b]) * 0x9E3779B97F4A7C15ULL;
+  return h;
+}
+
+// The kmers that hash to one partition, counted in an open addressing (linear probing) table indexed by the hash bits
+// after the partition bits. Each slot holds a kmer and its count (so a probe touches one cache line), a count of 0
+// marks an empty slot, and counts saturate. The table doubles when it is 3/4 full, so the memory needed stays near
+// that of the distinct kmers rather than that of every occurrence. The kmers it keeps end up in kmers.
+template <typename kmer_t, size_t partition_bits>
+struct _kmer_partition {
+  static const size_t min_table_bits = 12;
+  static const size_t prefetch_distance = 8;
+  struct entry {
+    kmer_t   kmer;
+    uint32_t count;
+  };
+
+  mutex          lock;
+  size_t         table_bits = 0;
+  size_t         size = 0;
+  vector<entry>  table;
+  vector<kmer_t> kmers;
+
+  size_t slot(uint64_t h) const { return (h << partition_bits) >> (64 - table_bits); }
+
+  void insert(const kmer_t & x, size_t i, uint32_t count) {
+    const size_t mask = table.size() - 1;
+    while (table[i].count && table[i].kmer != x) i = (i + 1) & mask;
+    if (!table[i].count) {
+      table[i].kmer = x;
+      size++;
+    }
+    table[i].count = (uint32_t)std::min((uint64_t)table[i].count + count, (uint64_t)UINT32_MAX);
+  }
+
+  void grow() {
+    vector<entry> old_table(size_t(1) << (table_bits? table_bits + 1 : min_table_bits), entry{kmer_t(0), 0});
+    old_table.swap(table);
+    table_bits = (table_bits)? table_bits + 1 : min_table_bits;
+    size = 0;
+    for (const entry & e : old_table) {
+      if (e.count) insert(e.kmer, slot(_kmer_hash(e.kmer)), e.count);
+    }
+  }
+
+  // hashes is scratch space for the slots of xs, so they can be prefetched ahead of the inserts
+  void add(const kmer_t * xs, size_t n, vector<uint64_t> & hashes) {
+    hashes.resize(n);
+    for (size_t j = 0; j < n; j++) hashes[j] = _kmer_hash(xs[j]);
+    lock_guard<mutex> guard(lock);
+    while ((size + n) * 4 > table.size() * 3) grow();
+    for (size_t j = 0; j < n; j++) {
+      if (j + prefetch_distance < n) __builtin_prefetch(&table[slot(hashes[j + prefetch_distance])], 1);
+      insert(xs[j], slot(hashes[j]), 1);
+    }
+  }
+
+  // Keeps the kmers that were seen at least min_count times
+  void finish(size_t min_count) {
+    size_t kept = 0;
+    for (const entry & e : table) kept += e.count && e.count >= min_count;
+    kmers.reserve(kept);
+    for (const entry & e : table) {
+      if (e.count && e.count >= min_count) kmers.push_back(e.kmer);
+    }
+    vector<entry>().swap(table);
+  }
+};
+
+// Hands batches from the reader to the workers, holding at most capacity of them
+template <typename T>
+class _batch_queue {
+  mutex              _lock;
+  condition_variable _not_empty, _not_full;
+  deque<T>           _items;
+  size_t             _capacity;
+  bool               _closed = false;
+
+  public:
+  _batch_queue(size_t capacity) : _capacity(capacity) {}
+
+  void push(T & x) {
+    unique_lock<mutex> guard(_lock);
+    _not_full.wait(guard, [&]() { return _items.size() < _capacity; });
+    _items.push_back(std::move(x));
+    _not_empty.notify_one();
+  }
+
+  // Returns false once the queue is closed and empty
+  bool pop(T & x) {
+    unique_lock<mutex> guard(_lock);
+    _not_empty.wait(guard, [&]() { return !_items.empty() || _closed; });
+    if (_items.empty()) return false;
+    x = std::move(_items.front());
+    _items.pop_front();
+    _not_full.notify_one();
+    return true;
+  }
+
+  void close() {
+    lock_guard<mutex> guard(_lock);
+    _closed = true;
+    _not_empty.notify_all();
+  }
+};
+
+// Counts the kmers of file_name with num_threads workers, and returns the ones seen at least min_count times at the
+// start of an array with room for slots_per_kmer kmers for each of them (the tables convert needs)
+template <typename kmer_t>
+kmer_t * count_kmers(const char * file_name, const uint32_t k, size_t min_count, size_t slots_per_kmer,
+                     size_t num_threads, size_t * num_kmers) {
+  auto count_start = chrono::high_resolution_clock::now();
+  const size_t partition_bits = 8;
+  const size_t num_partitions = 1 << partition_bits;
+  const size_t local_len      = 1024; // kmers each worker collects per partition before adding them
+  vector<_kmer_partition<kmer_t, partition_bits>> partitions(num_partitions);
+  _batch_queue<vector<string>> queue(2 * num_threads);
+  atomic<size_t> num_occurrences(0);
+
+  auto work = [&]() {
+    vector<vector<kmer_t>> local(num_partitions);
+    for (auto & buffer : local) buffer.reserve(local_len);
+    vector<uint64_t> hashes;
+    size_t occurrences = 0;
+    auto visit = [&](const kmer_t & x) {
+      size_t p = _kmer_hash(x) >> (64 - partition_bits);
+      local[p].push_back(x);
+      if (local[p].size() == local_len) {
+        partitions[p].add(local[p].data(), local_len, hashes);
+        local[p].clear();
+      }
+      occurrences++;
+    };
+    vector<string> batch;
+    while (queue.pop(batch)) {
+      for (const auto & seq : batch) for_each_canonical_kmer<kmer_t>(seq, k, visit);
+    }
+    for (size_t p = 0; p < num_partitions; p++) {
+      if (!local[p].empty()) partitions[p].add(local[p].data(), local[p].size(), hashes);
+    }
+    num_occurrences += occurrences;
+  };
+
+  vector<thread> workers;
+  for (size_t t = 0; t < num_threads; t++) workers.push_back(thread(work));
+  read_batcher reader(file_name, k);
+  vector<string> batch;
+  while (reader.next(batch)) queue.push(batch);
+  queue.close();
+  for (auto & t : workers) t.join();
+  workers.clear();
+
+  // Each worker finishes a partition at a time
+  atomic<size_t> next_partition(0);
+  for (size_t t = 0; t < num_threads; t++) {
+    workers.push_back(thread([&]() {
+      for (size_t p; (p = next_partition++) < num_partitions;) partitions[p].finish(min_count);
+    }));
+  }
+  for (auto & t : workers) t.join();
+
+  size_t total = 0;
+  for (auto & partition : partitions) total += partition.kmers.size();
+  fprintf(stderr, "Counted %zu kmers of %zu sequences (%.3f GB of bases) in %.3f s: %zu distinct with count >= %zu\n",
+          num_occurrences.load(), reader.num_sequences, reader.num_bases / 1e9,
+          chrono::duration<double>(chrono::high_resolution_clock::now() - count_start).count(), total, min_count);
+  if (total == 0) {
+    fprintf(stderr, "ERROR: File %s has no kmers of length %u (with count >= %zu).\n", file_name, k, min_count);
+    exit(EXIT_FAILURE);
+  }
+
+  kmer_t * kmers = (kmer_t*)malloc(total * slots_per_kmer * sizeof(kmer_t));
+  if (!kmers) {
+    cerr << "Error allocating space for kmers" << endl;
+    exit(1);
+  }
+  kmer_t * out = kmers;
+  for (auto & partition : partitions) {
+    out = std::copy(partition.kmers.begin(), partition.kmers.end(), out);
+    vector<kmer_t>().swap(partition.kmers);
+  }
+  *num_kmers = total;
+  return kmers;
+}
+
+// Same as dsk_read_all_kmers, but counts the kmers of the reads in a FASTA or FASTQ file (optionally gzipped) instead,
+// keeping those seen at least min_count times. kmer_num_bits is set to the width DSK would have used for k (so
+// k <= 128). Exits with a message on errors.
+inline uint64_t * count_read_kmers(const char * file_name, const uint32_t k, size_t min_count, size_t slots_per_kmer,
+                                   size_t num_threads, uint32_t * kmer_num_bits, size_t * num_kmers) {
+  *kmer_num_bits = (k * NT_WIDTH + BLOCK_WIDTH - 1) / BLOCK_WIDTH * BLOCK_WIDTH;
+  num_threads = std::max((size_t)1, num_threads);
+  uint64_t * kmers = 0;
+  switch (*kmer_num_bits) {
+    case 64:  kmers = count_kmers<uint64_t>(file_name, k, min_count, slots_per_kmer, num_threads, num_kmers); break;
+    case 128: kmers = (uint64_t*)count_kmers<uint128_t>(file_name, k, min_count, slots_per_kmer, num_threads, num_kmers); break;
+    case 192: kmers = (uint64_t*)count_kmers<uint192_t>(file_name, k, min_count, slots_per_kmer, num_threads, num_kmers); break;
+    case 256: kmers = (uint64_t*)count_kmers<uint256_t>(file_name, k, min_count, slots_per_kmer, num_threads, num_kmers); break;
+    default:
+      fprintf(stderr, "ERROR: Kmers longer than 128 nts are not currently supported (k = %u).\n", k);
+      exit(EXIT_FAILURE);
+  }
+  return kmers;
+}
+
+#endif
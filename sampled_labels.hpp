@@ -0,0 +1,188 @@
+#pragma once
+#ifndef _SAMPLED_LABELS_HPP
+#define _SAMPLED_LABELS_HPP
+
+#include <vector>
+#include <array>
+#include <string>
+#include <iostream>
+
+#include <sdsl/bit_vectors.hpp>
+#include <sdsl/int_vector.hpp>
+
+#include "debruijn_graph.hpp"
+
+using namespace std;
+using namespace sdsl;
+
+// Stores the labels of some nodes of a debruijn_graph, so that node_label can stop walking backward as soon as it
+// reaches one of them (like SA sampling in an FM-index). The nodes are chosen so that any node reaches a sampled one
+// (or the all-$ node) within sample_rate backward steps, which makes a label O(sample_rate) instead of O(k).
+//
+// Each node's backward step goes to a single node, so the nodes form in-trees (plus cycles). A node is sampled
+// when an unsampled node sample_rate steps below it would otherwise have no sample in reach, working up from the
+// leaves, and then around each cycle.
+template <class t_graph = debruijn_graph<>>
+class sampled_node_labels {
+  public:
+  typedef typename t_graph::label_type  label_type;
+  typedef typename t_graph::symbol_type symbol_type;
+  typedef uint64_t size_type;
+  static const size_t sigma = t_graph::sigma;
+
+  private:
+  uint64_t               m_sample_rate = 0;
+  uint64_t               m_label_len   = 0; // k-1
+  bit_vector             m_sampled;         // per node
+  rank_support_v5<>      m_sampled_rank;
+  int_vector<>           m_labels;          // label_len symbols per sampled node, in node order
+  array<uint64_t, sigma+1> m_symbol_ranks{}; // g.m_node_rank(_symbol_start(x)+1), as used in _backward
+
+  size_t _parent(const t_graph & g, size_t v) const {
+    // the edge _backward finds needn't be the first of its node
+    return g.m_node_rank(g._backward(g._node_to_edge(v)) + 1) - 1;
+  }
+
+  public:
+  sampled_node_labels() {}
+
+  sampled_node_labels(const t_graph & g, size_t sample_rate) : m_sample_rate(sample_rate), m_label_len(g.k-1) {
+    size_t n = g.num_nodes();
+    m_sampled = bit_vector(n, 0);
+    for (symbol_type x = 0; x < sigma+1; x++) {
+      size_t start = (x == 0)? 0 : g.m_symbol_ends[x-1];
+      m_symbol_ranks[x] = g.m_node_rank(std::min(start+1, g.num_edges()));
+    }
+    // A label never needs more than k-2 backward steps
+    if (sample_rate + 2 < g.k && n > 0) {
+      _choose_samples(g, sample_rate);
+    }
+    m_sampled_rank = rank_support_v5<>(&m_sampled);
+
+    size_t num_samples = m_sampled_rank(n);
+    m_labels = int_vector<>(num_samples * m_label_len, 0, bits::hi(sigma) + 1);
+    for (size_t v = 0, s = 0; v < n; v++) {
+      if (!m_sampled[v]) continue;
+      label_type label = g.node_label(v);
+      for (size_t pos = 0; pos < m_label_len; pos++) m_labels[s * m_label_len + pos] = g._unmap_symbol(label[pos]);
+      s++;
+    }
+  }
+
+  sampled_node_labels(const sampled_node_labels & other) { *this = other; }
+  sampled_node_labels & operator=(const sampled_node_labels & other) {
+    m_sample_rate  = other.m_sample_rate;
+    m_label_len    = other.m_label_len;
+    m_sampled      = other.m_sampled;
+    m_sampled_rank = rank_support_v5<>(&m_sampled);
+    m_labels       = other.m_labels;
+    m_symbol_ranks = other.m_symbol_ranks;
+    return *this;
+  }
+
+  size_t sample_rate() const { return m_sample_rate; }
+  size_t num_samples() const { return m_sampled_rank(m_sampled.size()); }
+
+  label_type node_label(const t_graph & g, size_t v) const {
+    return node_label_from_edge(g, g._node_to_edge(v));
+  }
+
+  // Same as debruijn_graph::node_label_from_edge, but stops at the first sampled node
+  label_type node_label_from_edge(const t_graph & g, size_t i) const {
+    label_type label = label_type(m_label_len, g._map_symbol(symbol_type{}));
+    for (size_t pos = 1; pos <= m_label_len; pos++) {
+      symbol_type x = g._symbol_access(i);
+      // All are $ before the last $
+      if (x == 0) return label;
+      // nodes up to and including i's (which _backward needs too)
+      size_t node_rank = g.m_node_rank(i+1);
+      if (m_sampled[node_rank-1]) {
+        // label is the end of the sampled label followed by the pos-1 symbols read so far
+        size_t base = m_sampled_rank(node_rank-1) * m_label_len;
+        for (size_t t = 0; t + pos <= m_label_len; t++) label[t] = g._map_symbol(m_labels[base + t + pos - 1]);
+        return label;
+      }
+      label[m_label_len-pos] = g._map_symbol(x);
+      if (pos == m_label_len) break;
+      size_t nth = node_rank - m_symbol_ranks[x];
+      i = g.m_edges.select(nth+1, g._with_edge_flag(x, false));
+    }
+    return label;
+  }
+
+  // First symbol of the label of the node of edge i (as in debruijn_graph::_first_symbol, e.g. for incoming)
+  symbol_type first_symbol(const t_graph & g, size_t i) const {
+    return g._unmap_symbol(node_label_from_edge(g, i)[0]);
+  }
+
+  size_type serialize(ostream & out, structure_tree_node * v = nullptr, string name = "") const {
+    structure_tree_node * child = structure_tree::add_child(v, name, util::class_name(*this));
+    size_type written_bytes = 0;
+    written_bytes += write_member(m_sample_rate, out, child, "sample_rate");
+    written_bytes += write_member(m_label_len, out, child, "label_len");
+    written_bytes += m_sampled.serialize(out, child, "sampled");
+    written_bytes += m_sampled_rank.serialize(out, child, "sampled_rank");
+    written_bytes += m_labels.serialize(out, child, "labels");
+    written_bytes += write_member(m_symbol_ranks, out, child, "symbol_ranks");
+    structure_tree::add_size(child, written_bytes);
+    return written_bytes;
+  }
+
+  void load(istream & in) {
+    read_member(m_sample_rate, in);
+    read_member(m_label_len, in);
+    m_sampled.load(in);
+    m_sampled_rank.load(in, &m_sampled);
+    m_labels.load(in);
+    read_member(m_symbol_ranks, in);
+  }
+
+  private:
+  void _choose_samples(const t_graph & g, size_t sample_rate) {
+    size_t n = g.num_nodes();
+    // backward step of each node (the all-$ node, where labels end anyway, is its own parent)
+    int_vector<> parent(n, 0, bits::hi(n) + 1);
+    vector<uint8_t> children(n, 0);
+    for (size_t v = 0; v < n; v++) {
+      if (g._symbol_access(g._node_to_edge(v)) == 0) {
+        parent[v] = v;
+        continue;
+      }
+      parent[v] = _parent(g, v);
+      children[parent[v]]++;
+    }
+    // 1 + the furthest distance up from a node that has no sample in reach yet (0 -> none)
+    vector<uint16_t> reach(n, 1);
+    auto finish = [&](size_t v, size_t distance) -> size_t {
+      if (distance >= sample_rate) {
+        m_sampled[v] = 1;
+        return 0;
+      }
+      return distance + 1;
+    };
+    vector<size_t> leaves;
+    for (size_t v = 0; v < n; v++) if (children[v] == 0) leaves.push_back(v);
+    while (!leaves.empty()) {
+      size_t v = leaves.back();
+      leaves.pop_back();
+      size_t p = parent[v];
+      if (p == v) continue; // labels end at the all-$ node, so it acts as a sample
+      size_t up = finish(v, reach[v] - 1);
+      reach[p] = std::max((size_t)reach[p], up + 1);
+      if (--children[p] == 0) leaves.push_back(p);
+    }
+    // What is left are cycles: sample one node of each and go around it from there
+    for (size_t c = 0; c < n; c++) {
+      if (children[c] == 0) continue;
+      m_sampled[c] = 1;
+      children[c] = 0;
+      size_t up = 0;
+      for (size_t v = parent[c]; v != c; v = parent[v]) {
+        up = finish(v, std::max((size_t)reach[v] - 1, up));
+        children[v] = 0;
+      }
+    }
+  }
+};
+
+#endif
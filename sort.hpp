@@ -1,6 +1,13 @@
 #ifndef SORT_HPP
 #define SORT_HPP
 
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <atomic>
+
 // Radix sorts colex(range (hi, lo]) of each record table_a
 // using table_b as the temporary table, and writing the new ptrs to
 // new_a and new_b. new_a will point to the final result, while
@@ -66,4 +73,203 @@ void colex_partial_radix_sort(T * a, T * b, size_t num_records, uint32_t lo, uin
   }
 }
 
+// One stable counting sort pass of a into b, keyed by digit_of(record) in [0, num_digits).
+// With more than one thread, the records are split into contiguous chunks, the digits are counted per chunk,
+// and the counts are prefix summed in (digit, chunk) order so that each thread can scatter its chunk stably
+// into its own slots of each bucket.
+template <typename T, typename D>
+void _radix_sort_pass(const T * a, T * b, size_t num_records, size_t num_digits, D digit_of, size_t num_threads) {
+  if (num_threads < 1 || num_records < num_threads) num_threads = 1;
+  size_t chunk_size = (num_records + num_threads - 1)/num_threads;
+  // counts[t][c] -> after the prefix sum, the next free slot for digit c in chunk t
+  std::vector<std::vector<size_t>> counts(num_threads, std::vector<size_t>(num_digits, 0));
+
+  // Runs f(t, chunk_lo, chunk_hi) on each chunk (in its own thread if there are several)
+  auto for_each_chunk = [&](std::function<void(size_t, size_t, size_t)> f) {
+    if (num_threads == 1) {
+      f(0, 0, num_records);
+      return;
+    }
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < num_threads; t++) {
+      size_t chunk_lo = std::min(t * chunk_size, num_records);
+      size_t chunk_hi = std::min(chunk_lo + chunk_size, num_records);
+      workers.push_back(std::thread(f, t, chunk_lo, chunk_hi));
+    }
+    for (auto & w : workers) w.join();
+  };
+
+  for_each_chunk([&](size_t t, size_t chunk_lo, size_t chunk_hi) {
+    size_t * bases = &counts[t][0];
+    for (size_t i = chunk_lo; i < chunk_hi; i++) bases[digit_of(a[i])]++;
+  });
+
+  // prefix sum over (digit, chunk) pairs, so earlier chunks come first within each bucket (stability)
+  size_t total = 0;
+  for (size_t c = 0; c < num_digits; c++) {
+    for (size_t t = 0; t < num_threads; t++) {
+      size_t count = counts[t][c];
+      counts[t][c] = total;
+      total += count;
+    }
+  }
+
+  for_each_chunk([&](size_t t, size_t chunk_lo, size_t chunk_hi) {
+    size_t * bases = &counts[t][0];
+    for (size_t i = chunk_lo; i < chunk_hi; i++) b[bases[digit_of(a[i])]++] = a[i];
+  });
+}
+
+// Multithreaded version of the above (for fixed length records only).
+// new_a and new_b are set the same way as the serial version.
+template <int base, typename T, typename F>
+void colex_partial_radix_sort(T * a, T * b, size_t num_records, uint32_t lo, uint32_t hi, T ** new_a, T ** new_b, F get_digit,
+    size_t num_threads) {
+  if (num_threads <= 1) {
+    colex_partial_radix_sort<base>(a, b, num_records, lo, hi, new_a, new_b, get_digit);
+    return;
+  }
+  if (hi <= lo) return;
+  for (ssize_t digit_pos = hi-1; digit_pos >= lo; digit_pos--) {
+    _radix_sort_pass(a, b, num_records, base, [&](const T & x) { return get_digit(x, digit_pos); }, num_threads);
+    std::swap(a, b);
+  }
+  *new_a = a;
+  *new_b = b;
+}
+
+// The passes of colex_static_radix_sort, from digit hi-1 down to lo
+template <int base, uint32_t lo, uint32_t hi>
+struct _static_radix_passes {
+  template <typename T, typename F>
+  static void run(T *& a, T *& b, size_t num_records, F & get_digit, size_t num_threads) {
+    _radix_sort_pass(a, b, num_records, base, [&](const T & x) { return get_digit(x, hi-1); }, num_threads);
+    std::swap(a, b);
+    _static_radix_passes<base, lo, hi-1>::run(a, b, num_records, get_digit, num_threads);
+  }
+};
+
+template <int base, uint32_t lo>
+struct _static_radix_passes<base, lo, lo> {
+  template <typename T, typename F>
+  static void run(T *&, T *&, size_t, F &, size_t) {}
+};
+
+// Same as colex_partial_radix_sort (fixed length records), for a digit range known at compile time (e.g. [0, k) for
+// a static_k, see kmer.hpp). The passes are unrolled, so get_digit is always called with a constant position.
+template <int base, uint32_t lo, uint32_t hi, typename T, typename F>
+void colex_static_radix_sort(T * a, T * b, size_t num_records, T ** new_a, T ** new_b, F get_digit, size_t num_threads = 1) {
+  static_assert(lo < hi, "Need at least one digit");
+  _static_radix_passes<base, lo, hi>::run(a, b, num_records, get_digit, num_threads);
+  *new_a = a;
+  *new_b = b;
+}
+
+constexpr size_t _static_pow(size_t x, size_t y) { return (y == 0)? 1 : x * _static_pow(x, y-1); }
+
+// Like colex_partial_radix_sort, but sorts digits_per_pass digits at a time (with base^digits_per_pass buckets),
+// which needs far fewer passes over memory for large k. get_digits(x, pos, width) should return digits [pos, pos+width)
+// as a single number (digit pos being the most significant).
+// The last pass (digit lo) is always a single digit pass, so new_b still gets the table sorted by (lo, hi)
+// like the other versions. If pass_times is provided, the duration (in seconds) of each pass is appended to it.
+template <int base, int digits_per_pass, typename T, typename F>
+void colex_partial_wide_radix_sort(T * a, T * b, size_t num_records, uint32_t lo, uint32_t hi, T ** new_a, T ** new_b,
+    F get_digits, size_t num_threads = 1, std::vector<double> * pass_times = 0) {
+  static_assert(digits_per_pass >= 1, "Need at least one digit per pass");
+  if (hi <= lo) return;
+
+  // Each pass only counts the base^width digits it sorts by (so the last, single digit pass has base buckets)
+  auto pass = [&](uint32_t pos, uint32_t width) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    _radix_sort_pass(a, b, num_records, _static_pow(base, width), [&](const T & x) { return get_digits(x, pos, width); },
+                     num_threads);
+    std::swap(a, b);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    if (pass_times) pass_times->push_back(std::chrono::duration<double>(t2 - t1).count());
+  };
+
+  // (lo, hi] in groups from the right (the leftmost group may be narrower), then lo on its own
+  for (uint32_t end = hi; end > lo + 1; ) {
+    uint32_t start = std::max(lo + 1, end - std::min(end, (uint32_t)digits_per_pass));
+    pass(start, end - start);
+    end = start;
+  }
+  pass(lo, 1);
+
+  *new_a = a;
+  *new_b = b;
+}
+
+// Moves each record of a into its bucket by digits [pos, pos+width) in place (American flag sort).
+// Returns the bucket boundaries (bucket c is [starts[c], starts[c+1])).
+template <typename T, typename F>
+std::vector<size_t> _inplace_radix_partition(T * a, size_t num_records, uint32_t pos, uint32_t width, F & get_digits) {
+  size_t num_digits = size_t(1) << (2 * width);
+  std::vector<size_t> starts(num_digits + 1, 0);
+  for (size_t i = 0; i < num_records; i++) starts[get_digits(a[i], pos, width) + 1]++;
+  for (size_t c = 1; c <= num_digits; c++) starts[c] += starts[c-1];
+
+  // Swap each element into its bucket, filling the buckets from the left
+  std::vector<size_t> next(starts.begin(), starts.end() - 1);
+  for (size_t c = 0; c < num_digits; c++) {
+    while (next[c] < starts[c+1]) {
+      T x = a[next[c]];
+      size_t d = get_digits(x, pos, width);
+      while (d != c) {
+        std::swap(x, a[next[d]++]);
+        d = get_digits(x, pos, width);
+      }
+      a[next[c]++] = x;
+    }
+  }
+  return starts;
+}
+
+// In-place MSD radix sort on digits [pos, hi) of a. Small buckets are finished with std::sort,
+// so less has to agree with the digit order.
+template <typename T, typename F, typename Less>
+void _inplace_radix_sort_rec(T * a, size_t num_records, uint32_t pos, uint32_t hi, uint32_t max_width, F & get_digits, Less & less) {
+  const size_t small_size = 64;
+  if (num_records <= small_size) {
+    std::sort(a, a + num_records, less);
+    return;
+  }
+  if (pos >= hi) return;
+  uint32_t width = std::min(max_width, hi - pos);
+  std::vector<size_t> starts = _inplace_radix_partition(a, num_records, pos, width, get_digits);
+  for (size_t c = 0; c + 1 < starts.size(); c++) {
+    _inplace_radix_sort_rec(a + starts[c], starts[c+1] - starts[c], pos + width, hi, max_width, get_digits, less);
+  }
+}
+
+// In-place (unstable) MSD radix sort by digits [lo, hi) (digit lo being the most significant), sorting
+// digits_per_pass 2-bit digits per level. Unlike the other sorts in here, it doesn't need a second table,
+// so it halves the memory needed (but doesn't give us the second last iteration).
+// get_digits is the same as for colex_partial_wide_radix_sort, and less has to agree with the digit order
+// (e.g. operator< for kmers, where all digits past hi are 0). With several threads, the buckets of the
+// first level are shared between them.
+template <int digits_per_pass, typename T, typename F, typename Less>
+void colex_inplace_radix_sort(T * a, size_t num_records, uint32_t lo, uint32_t hi, F get_digits, Less less, size_t num_threads = 1) {
+  if (hi <= lo || num_records < 2) return;
+  if (num_threads <= 1) {
+    _inplace_radix_sort_rec(a, num_records, lo, hi, digits_per_pass, get_digits, less);
+    return;
+  }
+  // Partition on the first digits here, then sort the buckets in parallel
+  uint32_t width = std::min((uint32_t)digits_per_pass, hi - lo);
+  std::vector<size_t> starts = _inplace_radix_partition(a, num_records, lo, width, get_digits);
+  std::atomic<size_t> next_bucket(0);
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < num_threads; t++) {
+    workers.push_back(std::thread([&]() {
+      F digits_f(get_digits);
+      Less less_f(less);
+      for (size_t c = next_bucket++; c + 1 < starts.size(); c = next_bucket++) {
+        _inplace_radix_sort_rec(a + starts[c], starts[c+1] - starts[c], lo + width, hi, digits_per_pass, digits_f, less_f);
+      }
+    }));
+  }
+  for (auto & w : workers) w.join();
+}
+
 #endif
@@ -2,6 +2,10 @@
 #ifndef _UTILITY_HPP
 #define _UTILITY_HPP
 
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h> // ssize_t
+
 template <typename value_type, class IndexFunction>
 ssize_t function_binary_search(size_t lo, size_t hi, value_type key, IndexFunction f) {
   while ( lo <= hi ) {
@@ -21,6 +25,65 @@ T & deconst(const T & x) {
   return const_cast<T&>(x);
 }
 
+// Position of the i-th (0-based) set bit of x
+inline size_t _select_in_word(uint64_t x, size_t i) {
+  for (; i > 0; i--) x &= x - 1;
+  return __builtin_ctzll(x);
+}
+
+// Hints that an access or rank at position i of v is coming up (see the batch queries in debruijn_graph.hpp).
+// Types with a prefetch(i) method (e.g. the vectors in mapped_graph.hpp and edge_vector.hpp) know exactly what they
+// will read. sdsl doesn't expose that, so its types are recognised by their public members (without including sdsl
+// here) and the words a query will probably start at are touched:
+//  - sd_vector: the high and low words near i, placed by assuming the ones are spread evenly (its select support
+//    isn't exposed, so that part of rank isn't prefetched);
+//  - wavelet trees (wt_huff etc.): the root level of bv at i (the lower levels depend on the ranks above them);
+//  - rrr_vector: the block type and block number words of the block holding i (placed evenly, like sd_vector);
+//  - plain bit/int vectors: the word holding i.
+template <int N> struct _prefetch_priority : _prefetch_priority<N-1> {};
+template <> struct _prefetch_priority<0> {};
+typedef _prefetch_priority<5> _prefetch_first;
+
+// the position in [0, m) proportional to i in [0, n)
+inline size_t _spread(size_t i, size_t n, size_t m) {
+  if (n == 0 || m == 0) return 0;
+  size_t x = (size_t)((double)i / n * m);
+  return (x < m)? x : m - 1;
+}
+
+template <class T>
+inline auto prefetch_hint(const T & v, size_t i, _prefetch_priority<5>) -> decltype(v.prefetch(i), void()) {
+  v.prefetch(i);
+}
+// sd_vector
+template <class T>
+inline auto prefetch_hint(const T & v, size_t i, _prefetch_priority<4>)
+    -> decltype(v.high.data(), v.low.data(), v.low.width(), (size_t)v.wl, void()) {
+  size_t ones = _spread(i, v.size(), v.low.size() + 1);
+  __builtin_prefetch(v.high.data() + ((i >> v.wl) + ones) / 64);
+  __builtin_prefetch(v.low.data() + ones * v.low.width() / 64);
+}
+// wavelet trees
+template <class T>
+inline auto prefetch_hint(const T & v, size_t i, _prefetch_priority<3>) -> decltype(v.bv.size(), void()) {
+  prefetch_hint(v.bv, i, _prefetch_first());
+}
+// rrr_vector
+template <class T>
+inline auto prefetch_hint(const T & v, size_t i, _prefetch_priority<2>)
+    -> decltype(v.bt.data(), v.bt.width(), v.btnr.data(), void()) {
+  __builtin_prefetch(v.bt.data() + _spread(i, v.size(), v.bt.size()) * v.bt.width() / 64);
+  __builtin_prefetch(v.btnr.data() + _spread(i, v.size(), v.btnr.size()) / 64);
+}
+// int_vector (and bit_vector)
+template <class T>
+inline auto prefetch_hint(const T & v, size_t i, _prefetch_priority<1>) -> decltype(v.data(), v.width(), void()) {
+  __builtin_prefetch(v.data() + i * v.width() / 64);
+}
+template <class T>
+inline void prefetch_hint(const T &, size_t, _prefetch_priority<0>) {}
+#define PREFETCH(v, i) prefetch_hint((v), (i), _prefetch_first())
+
 // This may not work in VS etc... Add code to support other compilers?
 #define clz(x) __builtin_clzll((x))
 
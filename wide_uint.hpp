@@ -0,0 +1,178 @@
+#pragma once
+#ifndef WIDE_UINT_HPP
+#define WIDE_UINT_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <climits> // For CHAR_BIT
+
+#include "uint128_t.hpp" // For bitwidth
+
+/* WIDE_UINT
+ * uint128_t generalized to num_blocks 64 bit blocks, for kmers that don't fit in 128 bits (uint192_t for
+ * 64 < k <= 96, uint256_t for 96 < k <= 128, as DSK stores them).
+ * It has the same layout as uint128_t (the most significant block first, and nothing else), so the kmer functions
+ * that index the blocks of a kmer directly work on both, and the same operations (bitwise, shifts and comparisons,
+ * where an integer RHS is taken to fit in one block). The loops over the blocks have constant bounds, so they unroll.
+ */
+template <size_t num_blocks>
+struct wide_uint {
+  private:
+  typedef uint64_t block_t;
+  const static size_t block_width = sizeof(block_t) * CHAR_BIT;
+  const static size_t total_width = num_blocks * block_width;
+  const static size_t last = num_blocks - 1; // the least significant block
+
+  bool upper_blocks_zero() const {
+    for (size_t b = 0; b < last; b++) if (_blocks[b]) return false;
+    return true;
+  }
+
+  public:
+  block_t _blocks[num_blocks];
+
+  // Constructors
+  wide_uint() { for (size_t b = 0; b < num_blocks; b++) _blocks[b] = 0; }
+  template <typename T>
+  wide_uint(const T & rhs) {
+    for (size_t b = 0; b < last; b++) _blocks[b] = 0;
+    _blocks[last] = rhs;
+  }
+
+  template <typename T>
+  wide_uint & operator=(const T & rhs) { return *this = wide_uint(rhs); }
+
+  // Bitwise Operators
+  wide_uint & operator&=(const wide_uint & rhs) {
+    for (size_t b = 0; b < num_blocks; b++) _blocks[b] &= rhs._blocks[b];
+    return *this;
+  }
+
+  wide_uint & operator|=(const wide_uint & rhs) {
+    for (size_t b = 0; b < num_blocks; b++) _blocks[b] |= rhs._blocks[b];
+    return *this;
+  }
+
+  wide_uint & operator^=(const wide_uint & rhs) {
+    for (size_t b = 0; b < num_blocks; b++) _blocks[b] ^= rhs._blocks[b];
+    return *this;
+  }
+
+  const wide_uint operator&(const wide_uint & rhs) const { return wide_uint(*this) &= rhs; }
+  const wide_uint operator|(const wide_uint & rhs) const { return wide_uint(*this) |= rhs; }
+  const wide_uint operator^(const wide_uint & rhs) const { return wide_uint(*this) ^= rhs; }
+  const wide_uint operator~() const {
+    wide_uint result;
+    for (size_t b = 0; b < num_blocks; b++) result._blocks[b] = ~_blocks[b];
+    return result;
+  }
+
+  template <typename T>
+  wide_uint & operator&=(const T & rhs) {
+    for (size_t b = 0; b < last; b++) _blocks[b] = 0;
+    _blocks[last] &= (block_t) rhs;
+    return *this;
+  }
+
+  template <typename T>
+  wide_uint & operator|=(const T & rhs) {
+    _blocks[last] |= (block_t) rhs;
+    return *this;
+  }
+
+  template <typename T>
+  wide_uint & operator^=(const T & rhs) {
+    _blocks[last] ^= (block_t) rhs;
+    return *this;
+  }
+
+  template <typename T>
+  wide_uint operator&(const T & rhs) const { return wide_uint(*this) &= rhs; }
+  template <typename T>
+  wide_uint operator|(const T & rhs) const { return wide_uint(*this) |= rhs; }
+  template <typename T>
+  wide_uint operator^(const T & rhs) const { return wide_uint(*this) ^= rhs; }
+
+  // Shift Operators
+  // Block b of the result takes the bits of the block shift/64 blocks away, and the rest from the one after that
+  template <typename T>
+  wide_uint operator<<(const T & rhs) const {
+    uint64_t shift = uint64_t(rhs);
+    wide_uint result;
+    if (shift >= total_width) return result;
+    size_t skip = shift / block_width, bits = shift % block_width;
+    for (size_t b = 0; b + skip < num_blocks; b++) {
+      result._blocks[b] = _blocks[b + skip] << bits;
+      if (bits && b + skip < last) result._blocks[b] |= _blocks[b + skip + 1] >> (block_width - bits);
+    }
+    return result;
+  }
+
+  template <typename T>
+  wide_uint operator>>(const T & rhs) const {
+    uint64_t shift = uint64_t(rhs);
+    wide_uint result;
+    if (shift >= total_width) return result;
+    size_t skip = shift / block_width, bits = shift % block_width;
+    for (size_t b = skip; b < num_blocks; b++) {
+      result._blocks[b] = _blocks[b - skip] >> bits;
+      if (bits && b > skip) result._blocks[b] |= _blocks[b - skip - 1] << (block_width - bits);
+    }
+    return result;
+  }
+
+  template <typename T>
+  wide_uint & operator<<=(const T & rhs) { return *this = *this << rhs; }
+
+  template <typename T>
+  wide_uint & operator>>=(const T & rhs) { return *this = *this >> rhs; }
+
+  // Comparison Functions
+  bool operator==(const wide_uint & rhs) const {
+    for (size_t b = 0; b < num_blocks; b++) if (_blocks[b] != rhs._blocks[b]) return false;
+    return true;
+  }
+
+  bool operator<(const wide_uint & rhs) const {
+    for (size_t b = 0; b < last; b++) {
+      if (_blocks[b] != rhs._blocks[b]) return _blocks[b] < rhs._blocks[b];
+    }
+    return _blocks[last] < rhs._blocks[last];
+  }
+
+  bool operator!=(const wide_uint & rhs) const { return !(*this == rhs); }
+  bool operator>(const wide_uint & rhs) const { return rhs < *this; }
+  bool operator>=(const wide_uint & rhs) const { return !(*this < rhs); }
+  bool operator<=(const wide_uint & rhs) const { return !(rhs < *this); }
+
+  template <typename T> bool operator==(const T & rhs) const {
+    return upper_blocks_zero() && _blocks[last] == (uint64_t) rhs;
+  }
+
+  template <typename T> bool operator!=(const T & rhs) const { return !(*this == rhs); }
+
+  template <typename T> bool operator>(const T & rhs) const {
+    return !upper_blocks_zero() || _blocks[last] > (uint64_t) rhs;
+  }
+
+  template <typename T> bool operator<(const T & rhs) const {
+    return upper_blocks_zero() && _blocks[last] < (uint64_t) rhs;
+  }
+
+  template <typename T> bool operator>=(const T & rhs) const { return !(*this < rhs); }
+  template <typename T> bool operator<=(const T & rhs) const { return !(*this > rhs); }
+
+  // Casting
+  operator bool() const { return (bool) _blocks[last]; }
+  operator char() const { return (char) _blocks[last]; }
+  operator int() const { return (int) _blocks[last]; }
+  operator uint8_t() const { return (uint8_t) _blocks[last]; }
+  operator uint16_t() const { return (uint16_t) _blocks[last]; }
+  operator uint32_t() const { return (uint32_t) _blocks[last]; }
+  operator uint64_t() const { return (uint64_t) _blocks[last]; }
+};
+
+typedef wide_uint<3> uint192_t;
+typedef wide_uint<4> uint256_t;
+
+#endif
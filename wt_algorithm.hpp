@@ -3,89 +3,129 @@
 #define _WT_ALGORITHM_H
 
 #include <vector>
-#include <string>
+#include <algorithm>
+#include <iterator>
 #include <sdsl/bits.hpp>
 #include <boost/optional.hpp>
 #include <sdsl/wt_algorithm.hpp>
 
-template <class t_wt>
-size_t _prev_lte_rec(const t_wt & wt, const typename t_wt::node_type & node, size_t i, typename t_wt::value_type c) {
-  if (i == 0) return 0;
+// Deepest a wavelet tree over 64 bit values can be
+const size_t _wt_max_depth = 64;
 
-  // at a leaf, we return the current position
-  if (wt.is_leaf(node)) {
-    return i;
+// The nodes on the path from the root to the leaf of c, expanded only as far as the queries along it have gone, so
+// that several queries for the same c share the expands (see prev_lte_batch and next_lte_batch).
+template <class t_wt>
+class _wt_symbol_path {
+  typedef typename t_wt::node_type  node_type;
+  typedef typename t_wt::value_type value_type;
+
+  const t_wt & m_wt;
+  value_type   m_c;
+  uint64_t     m_mask;
+  node_type    m_nodes[_wt_max_depth + 1];
+  size_t       m_expanded = 1;
+
+  public:
+  _wt_symbol_path(const t_wt & wt, value_type c) : m_wt(wt), m_c(c), m_mask((1ULL) << (wt.max_level - 1)) {
+    m_nodes[0] = wt.root();
   }
 
-  auto children = wt.expand(node);
-  auto left_child = std::get<0>(children);
-  auto right_child = std::get<1>(children);
-
-  uint64_t mask = (1ULL) << (wt.max_level - 1);
-  if (c & (mask >> node.level)) {
-    // Left tree elements are guaranteed to be < c, so no need to traverse further down that side
-    size_t left_rank = wt.node_rank0(node, i);
-    // select to count to the position of most recent element
-    size_t left_pos  = (left_rank)? wt.node_select0(node, left_rank) + 1: 0;
-    // unless left_pos == i, we have larger elements in our range that *could* be < c
-    // we have to traverse the right subtree to find their values
-    size_t right_rank     = wt.node_rank1(node, i);
-    size_t right_sub_rank = (right_rank)? _prev_lte_rec(wt, right_child, right_rank, c) : 0;
-    size_t right_pos  = (right_sub_rank)? wt.node_select1(node, right_sub_rank) + 1 : 0;
-    return std::max(left_pos, right_pos);
-  } else {
-    size_t rank = wt.node_rank0(node, i);
-    size_t sub  = (rank)? _prev_lte_rec(wt, left_child, rank, c) : 0;
-    size_t pos  = (sub)? wt.node_select0(node, sub) + 1 : 0;
-    return pos;
+  const t_wt & wt() const { return m_wt; }
+
+  const node_type & operator[](size_t depth) {
+    for (; m_expanded <= depth; m_expanded++) {
+      auto children = m_wt.expand(m_nodes[m_expanded-1]);
+      m_nodes[m_expanded] = (bit(m_expanded-1))? std::get<1>(children) : std::get<0>(children);
+    }
+    return m_nodes[depth];
   }
-}
 
-template <class t_wt>
-size_t _next_lte_rec(const t_wt & wt, const typename t_wt::node_type & node, size_t i, typename t_wt::value_type c) {
-  string pad(node.level * 2, ' ');
-  pad += "  ";
+  // c's bit at the node at depth (which has to have been reached already)
+  bool bit(size_t depth) const { return m_c & (m_mask >> m_nodes[depth].level); }
+};
 
-  if (i > node.size) {
-    return node.size+1;
+template <class t_wt>
+size_t _prev_lte(_wt_symbol_path<t_wt> & path, size_t i) {
+  const t_wt & wt = path.wt();
+  // Going down c's path, at each level where c has a 1 the left subtree elements are guaranteed to be < c, so the
+  // last of them before i is a candidate. The rest of the answer is further down the path.
+  size_t left_pos[_wt_max_depth];
+  size_t depth = 0;
+  size_t sub   = 0;
+  while (i > 0) {
+    const auto & node = path[depth];
+    // at a leaf, we return the current position
+    if (wt.is_leaf(node)) {
+      sub = i;
+      break;
+    }
+    if (path.bit(depth)) {
+      size_t left_rank = wt.node_rank0(node, i);
+      // select to count to the position of most recent element
+      left_pos[depth] = (left_rank)? wt.node_select0(node, left_rank) + 1 : 0;
+      i = wt.node_rank1(node, i);
+    } else {
+      left_pos[depth] = 0;
+      i = wt.node_rank0(node, i);
+    }
+    depth++;
   }
-
-  // at a leaf, we return the current position
-  if (wt.is_leaf(node)) {
-    return i;
+  // Then map the position found back up to the root, keeping the later of it and each level's candidate
+  while (depth-- > 0) {
+    const auto & node = path[depth];
+    size_t pos = 0;
+    if (sub) pos = ((path.bit(depth))? wt.node_select1(node, sub) : wt.node_select0(node, sub)) + 1;
+    sub = std::max(left_pos[depth], pos);
   }
+  return sub;
+}
+
+template <class t_wt>
+size_t _next_lte(_wt_symbol_path<t_wt> & path, size_t i) {
+  const t_wt & wt = path.wt();
   // Basic idea is the same, but need to select to next element.
   // and check if it goes past the global rank of that symbol
-
-  auto children = wt.expand(node);
-  auto left_child = std::get<0>(children);
-  auto right_child = std::get<1>(children);
-
-  uint64_t mask = (1ULL) << (wt.max_level - 1);
-  if (c & (mask >> node.level)) {
-    size_t node_bit = (wt.node_access(node, i-1)==1);
-    // right branch
-    // find the first 0 that occurs at i' >= i
-    size_t r0 = wt.node_rank0(node, i); // # 0s in [0,i)
-    size_t extend0 = (node_bit == 1);
-    size_t p = wt.node_select0(node, r0+extend0) + 1;
-    if (p == i) return p;
-    size_t r1 = wt.node_rank1(node, i); // # 1s in [0, i)
-    size_t extend1 = (node_bit==0);// || node_bit==0);// || (r1 < i && node_bit==0));
-    size_t rr = _next_lte_rec(wt, right_child, r1 + extend1, c);
-    size_t pos = wt.node_select1(node, rr) + 1;
-    return std::min(std::min(p, pos), (size_t)node.size+1);
-  } else {
-    // bit = 0 - must recurse on left branch
-    // number of 0s in [0, i)
-    size_t r0  = wt.node_rank0(node, i);
-    //size_t extend = (lr == 0 || (r0 < i && wt.node_access(node, i-1)==1));
-    size_t extend = (wt.node_access(node, i-1)==1);
-    size_t lr  = _next_lte_rec(wt, left_child, r0+extend, c);
-    size_t pos = wt.node_select0(node, lr) + 1;
-    if (pos > node.size) return node.size+1;
-    return pos;
+  size_t right_pos[_wt_max_depth]; // at the levels where c has a 1, the first 0 at or after i-1
+  size_t depth = 0;
+  size_t sub   = 0;
+  while (true) {
+    const auto & node = path[depth];
+    if (i > node.size) {
+      sub = node.size + 1;
+      break;
+    }
+    // at a leaf, we return the current position
+    if (wt.is_leaf(node)) {
+      sub = i;
+      break;
+    }
+    bool node_bit = (wt.node_access(node, i-1) == 1);
+    if (path.bit(depth)) {
+      // find the first 0 that occurs at i' >= i
+      size_t p = wt.node_select0(node, wt.node_rank0(node, i) + node_bit) + 1;
+      if (p == i) {
+        sub = p;
+        break;
+      }
+      right_pos[depth] = p;
+      i = wt.node_rank1(node, i) + !node_bit;
+    } else {
+      // bit = 0 - must go down the left branch
+      i = wt.node_rank0(node, i) + node_bit;
+    }
+    depth++;
+  }
+  while (depth-- > 0) {
+    const auto & node = path[depth];
+    if (path.bit(depth)) {
+      size_t pos = wt.node_select1(node, sub) + 1;
+      sub = std::min(std::min(right_pos[depth], pos), (size_t)node.size+1);
+    } else {
+      size_t pos = wt.node_select0(node, sub) + 1;
+      sub = (pos > node.size)? node.size+1 : pos;
+    }
   }
+  return sub;
 }
 
 // Answers on [0..i) range (so 0 returns 0, much like sdsl rank)
@@ -97,10 +137,10 @@ size_t prev_lte(const t_wt & wt, size_t i, typename t_wt::value_type c) {
 
   // Probs should do this better (w.r.t. cache)
   auto x = sdsl::symbol_lte(wt, c);
-  if (!get<0>(x)) return 0;
-  c = get<1>(x);
+  if (!std::get<0>(x)) return 0;
 
-  return _prev_lte_rec(wt, wt.root(), i, c);
+  _wt_symbol_path<t_wt> path(wt, std::get<1>(x));
+  return _prev_lte(path, i);
 }
 
 // Answers on [0..i) range (so 0 returns 0, much like sdsl rank)
@@ -111,23 +151,103 @@ size_t next_lte(const t_wt & wt, size_t i, typename t_wt::value_type c) {
   if (i == 0) return 0;
 
   auto x = sdsl::symbol_lte(wt, c);
-  if (!get<0>(x)) return 0;
-  c = get<1>(x);
+  if (!std::get<0>(x)) return 0;
+
+  _wt_symbol_path<t_wt> path(wt, std::get<1>(x));
+  return _next_lte(path, i);
+}
+
+// out[q] = prev_lte(wt, is[q], c). The symbol search and the nodes on its path are shared by all the queries.
+template <class t_wt>
+void prev_lte_batch(const t_wt & wt, const size_t * is, size_t n, typename t_wt::value_type c, size_t * out) {
+  static_assert(t_wt::lex_ordered, "prev_lte requires a lex_ordered WT");
+
+  auto x = sdsl::symbol_lte(wt, c);
+  _wt_symbol_path<t_wt> path(wt, std::get<1>(x));
+  for (size_t q = 0; q < n; q++) out[q] = (is[q] == 0 || !std::get<0>(x))? 0 : _prev_lte(path, is[q]);
+}
 
-  return _next_lte_rec(wt, wt.root(), i, c);
+// out[q] = next_lte(wt, is[q], c), as in prev_lte_batch
+template <class t_wt>
+void next_lte_batch(const t_wt & wt, const size_t * is, size_t n, typename t_wt::value_type c, size_t * out) {
+  static_assert(t_wt::lex_ordered, "next_lte requires a lex_ordered WT");
+
+  auto x = sdsl::symbol_lte(wt, c);
+  _wt_symbol_path<t_wt> path(wt, std::get<1>(x));
+  for (size_t q = 0; q < n; q++) out[q] = (is[q] == 0 || !std::get<0>(x))? 0 : _next_lte(path, is[q]);
 }
 
-// make iterators instead
-// random access next_lte (select_lte) is probably quite possible as well
+// next_lte(lcs, i, c) for a fixed c, for lte_range. With a WT, the symbol search and the nodes on its path are shared
+// by all the calls (as in range_lte). Other LCS vectors specialise it (see lcs_vector.hpp).
 template <class t_wt>
-vector<size_t> range_lte(const t_wt & wt, size_t i, size_t j, typename t_wt::value_type c) {
-  vector<size_t> range;
-  for (size_t next = i; next <= j; next++) {
-    next = next_lte(wt,next,c);
-    if (next > j) break;
-    range.push_back(next);
+class lte_finder {
+  static_assert(t_wt::lex_ordered, "lte_finder requires a lex_ordered WT");
+  typedef std::pair<bool, typename t_wt::value_type> symbol_type;
+
+  bool                  m_found;
+  _wt_symbol_path<t_wt> m_path;
+
+  lte_finder(const t_wt & wt, const symbol_type & x) : m_found(std::get<0>(x)), m_path(wt, std::get<1>(x)) {}
+
+  public:
+  lte_finder(const t_wt & wt, typename t_wt::value_type c) : lte_finder(wt, sdsl::symbol_lte(wt, c)) {}
+
+  // nothing is <= c
+  bool empty() const { return !m_found; }
+
+  size_t operator()(size_t i) { return (i == 0 || !m_found)? 0 : _next_lte(m_path, i); }
+};
+
+// The positions range_lte(lcs, i, j, c) lists, found as the range is iterated: nothing is allocated, and a caller
+// that stops early doesn't pay for the rest. The iterators point into the range, so it has to outlive them.
+template <class t_lcs>
+class lte_range {
+  public:
+  static const size_t npos = ~(size_t)0;
+
+  class const_iterator {
+    const lte_range * m_range;
+    size_t            m_pos;
+
+    public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef size_t                  value_type;
+    typedef ptrdiff_t               difference_type;
+    typedef const size_t *          pointer;
+    typedef const size_t &          reference;
+
+    const_iterator(const lte_range * range, size_t pos) : m_range(range), m_pos(pos) {}
+    reference operator*() const { return m_pos; }
+    const_iterator & operator++() { m_pos = m_range->_find(m_pos + 1); return *this; }
+    const_iterator operator++(int) { const_iterator old = *this; ++*this; return old; }
+    bool operator==(const const_iterator & other) const { return m_pos == other.m_pos; }
+    bool operator!=(const const_iterator & other) const { return m_pos != other.m_pos; }
+  };
+
+  private:
+  mutable lte_finder<t_lcs> m_finder; // a WT path is expanded as it goes
+  size_t                    m_first;
+  size_t                    m_last;
+
+  size_t _find(size_t i) const {
+    if (i > m_last) return npos;
+    size_t p = m_finder(i);
+    return (p > m_last)? npos : p;
   }
-  return range;
+
+  public:
+  lte_range(const t_lcs & lcs, size_t i, size_t j, typename t_lcs::value_type c)
+    : m_finder(lcs, c), m_first(i), m_last(j) {}
+
+  const_iterator begin() const { return const_iterator(this, (m_finder.empty())? npos : _find(m_first)); }
+  const_iterator end() const { return const_iterator(this, npos); }
+};
+
+// Positions p in [i, j] with lcs[p-1] <= c, as given by repeated next_lte (see lte_range to iterate them instead)
+template <class t_lcs>
+std::vector<size_t> range_lte(const t_lcs & lcs, size_t i, size_t j, typename t_lcs::value_type c) {
+  lte_range<t_lcs> range(lcs, i, j, c);
+  return std::vector<size_t>(range.begin(), range.end());
 }
 
 #endif